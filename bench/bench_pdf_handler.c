@@ -0,0 +1,193 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../include/pdf_handler.h"
+#include "../src/utf_transcode.h"
+
+#define DEFAULT_ITERATIONS 5
+#define TRANSCODE_DUMP_SIZE (8 * 1024 * 1024)  // 转码基准的文本大小（UTF-8 字节）
+
+// 辅助函数：读取文件内容
+static unsigned char* read_file(const char* filename, size_t* size) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+
+    unsigned char* buffer = (unsigned char*)malloc(*size);
+    if (!buffer) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(buffer, 1, *size, file) != *size) {
+        free(buffer);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    return buffer;
+}
+
+// 辅助函数：单调时钟（毫秒）
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void report(const char* name, double total_ms, int iterations) {
+    printf("%-32s %8d iters %10.3f ms/doc\n", name, iterations, total_ms / iterations);
+}
+
+// 基准：每次调用都初始化/销毁 PDFium 库
+static void bench_one_shot(const unsigned char* data, size_t size,
+                           const char* target, const char* replacement, int iterations) {
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        size_t modified_size;
+        unsigned char* result = replace_text_in_pdf_stream(
+            data, size, target, replacement, &modified_size);
+        free(result);
+    }
+    report("replace_text_in_pdf_stream", now_ms() - start, iterations);
+}
+
+// 基准：在同一个引擎上重复调用
+static void bench_engine(const unsigned char* data, size_t size,
+                         const char* target, const char* replacement, int iterations) {
+    pdf_engine_t* engine = pdf_engine_create();
+    if (!engine) {
+        fprintf(stderr, "Failed to create engine\n");
+        return;
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        size_t modified_size;
+        unsigned char* result = pdf_engine_replace_text(
+            engine, NULL, data, size, target, replacement, &modified_size, NULL);
+        free(result);
+    }
+    report("pdf_engine_replace_text", now_ms() - start, iterations);
+
+    pdf_engine_destroy(engine);
+}
+
+// 基准：只搜索命中位置，不重写也不保存
+static void bench_search(const unsigned char* data, size_t size, const char* target, int iterations) {
+    pdf_engine_t* engine = pdf_engine_create();
+    if (!engine) {
+        fprintf(stderr, "Failed to create engine\n");
+        return;
+    }
+
+    size_t hit_count = 0;
+    double start = now_ms();
+    for (int i = 0; i < iterations; i++) {
+        pdf_search_hit_t* hits = NULL;
+        pdf_engine_search(engine, NULL, data, size, &target, 1, &hits, &hit_count, NULL);
+        pdf_search_hits_free(hits);
+    }
+    report("pdf_engine_search", now_ms() - start, iterations);
+
+    pdf_engine_destroy(engine);
+}
+
+// 生成约 size 字节的 UTF-8 文本：按 period 个 ASCII 单词插入一个非 ASCII 片段，period 为 0 时全部是 ASCII
+static char* make_text_dump(size_t size, int period, const char* extra, size_t* out_len) {
+    static const char* words[] = { "Shenzhen ", "certificate ", "INSPIRE ", "test ", "2024-4-11 " };
+    char* text = (char*)malloc(size + 64);
+    if (!text) return NULL;
+
+    size_t len = 0;
+    int n = 0;
+    while (len < size) {
+        const char* piece = (period > 0 && n % period == period - 1) ? extra : words[n % 5];
+        size_t piece_len = strlen(piece);
+        memcpy(text + len, piece, piece_len);
+        len += piece_len;
+        n++;
+    }
+    *out_len = len;
+    return text;
+}
+
+typedef size_t (*utf8_decoder_t)(const char*, size_t, unsigned short*);
+
+static void bench_transcode_pair(const char* name, const char* utf8, size_t utf8_len, int iterations) {
+    unsigned short* utf16 = (unsigned short*)malloc(UTF16_MAX_UNITS_FOR_UTF8(utf8_len) * sizeof(unsigned short));
+    if (!utf16) return;
+
+    static const utf8_decoder_t decoders[] = { utf8_to_utf16_scalar, utf8_to_utf16 };
+    static const char* variants[] = { "scalar", "simd" };
+
+    for (int v = 0; v < 2; v++) {
+        double start = now_ms();
+        for (int i = 0; i < iterations; i++) decoders[v](utf8, utf8_len, utf16);
+        double decode_ms = (now_ms() - start) / iterations;
+
+        printf("%-14s %-6s utf8->utf16 %8.1f MB/s\n", name, variants[v], utf8_len / 1e3 / decode_ms);
+    }
+
+    free(utf16);
+}
+
+// 基准：标量与 SIMD 转码在多 MB 文本上的吞吐量
+static void bench_transcode(int iterations) {
+    static const struct {
+        const char* name;
+        int period;
+        const char* extra;
+    } dumps[] = {
+        { "ascii", 0, "" },
+        { "latin-mixed", 4, "Größe für Öl " },
+        { "cjk-emoji", 1, "深圳市大疆创新 \xF0\x9F\x98\x80 \xF0\xA0\x80\x80 " },
+    };
+
+    for (size_t d = 0; d < sizeof(dumps) / sizeof(dumps[0]); d++) {
+        size_t len;
+        char* text = make_text_dump(TRANSCODE_DUMP_SIZE, dumps[d].period, dumps[d].extra, &len);
+        if (!text) continue;
+        bench_transcode_pair(dumps[d].name, text, len, iterations);
+        free(text);
+    }
+}
+
+/**
+ * 基准测试入口
+ *
+ * 用法：bench_pdf_handler [input_pdf] [iterations] [target_text] [replacement_text]
+ */
+int main(int argc, char* argv[]) {
+    const char* input_file = argc > 1 ? argv[1] : "tests/test.pdf";
+    int iterations = argc > 2 ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+    const char* target = argc > 3 ? argv[3] : "test";
+    const char* replacement = argc > 4 ? argv[4] : "sample";
+
+    if (iterations <= 0) iterations = DEFAULT_ITERATIONS;
+
+    size_t size;
+    unsigned char* data = read_file(input_file, &size);
+    if (!data) {
+        fprintf(stderr, "Failed to read %s\n", input_file);
+        return 1;
+    }
+
+    printf("Input: %s (%zu bytes), target \"%s\" -> \"%s\"\n",
+           input_file, size, target, replacement);
+
+    bench_one_shot(data, size, target, replacement, iterations);
+    bench_engine(data, size, target, replacement, iterations);
+    bench_search(data, size, target, iterations);
+    bench_transcode(iterations);
+
+    free(data);
+    return 0;
+}
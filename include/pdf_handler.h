@@ -13,9 +13,202 @@ typedef enum {
     PDF_ERROR_NO_TEXT_FOUND = -4
 } pdf_error_code_t;
 
+// 单页处理状态
+typedef enum {
+    PDF_PAGE_OK = 0,                // 页面已正常处理
+    PDF_PAGE_LOAD_FAILED = 1,       // 页面加载失败，已跳过
+    PDF_PAGE_TEXT_LOAD_FAILED = 2   // 页面文本层加载失败，已跳过
+} pdf_page_status_t;
+
+// 单页诊断信息
+typedef struct {
+    int page_index;             // 页码（从 0 开始）
+    pdf_page_status_t status;   // 页面处理状态
+    int hits;                   // 该页替换的目标文本处数
+} pdf_page_diagnostic_t;
+
+/**
+ * 单次调用的分阶段耗时与计数
+ *
+ * 耗时取自单调时钟，单位为毫秒。跳过的页数、重写的页数和暂存区的分配次数见 pdf_result_t 中的对应字段。
+ */
+typedef struct {
+    double total_ms;            // 处理文档的总耗时（参数验证到保存完成，不含最后一次流式写出）
+    double load_ms;             // 加载文档（FPDF_LoadMemDocument64 / FPDF_LoadCustomDocument）
+    double page_load_ms;        // 加载页面（FPDF_LoadPage）
+    double text_page_ms;        // 加载文本页（FPDFText_LoadPage）
+    double scan_ms;             // 扫描：预筛选、读取文本对象并匹配，或文本页搜索
+    double apply_ms;            // 执行替换：重写、删除文本对象（只搜索时为记录命中）
+    double generate_ms;         // 重新生成内容流（FPDFPage_GenerateContent）
+    double save_ms;             // 保存文档（FPDF_SaveAsCopy，含写出；直通时为复制输入）
+    size_t pages_loaded;        // FPDF_LoadPage 成功的次数
+    size_t objects_scanned;     // 读取了文本的文本对象数
+    size_t hits;                // 所有替换组的命中总数
+    size_t bytes_in;            // 输入字节数
+    size_t bytes_out;           // 输出字节数（直通借用输入时等于输入大小，只搜索时为 0）
+    size_t output_allocations;  // 内存输出缓冲区的分配次数（含增长，调用方提供的缓冲区够用时为 0）
+    size_t output_writes;       // 流式输出调用回调或 writev 的次数
+} pdf_stats_t;
+
+/**
+ * 单次调用的结果
+ *
+ * 由调用方分配并传入，函数返回后包含本次调用的错误代码、错误消息和逐页诊断。
+ * 每个调用使用各自的结果结构，因此多个线程可以同时调用而不会互相覆盖。
+ * 使用完毕后需要调用 pdf_result_free 释放 pages。
+ */
+typedef struct {
+    pdf_error_code_t code;          // 错误代码，成功时为 PDF_SUCCESS
+    char message[256];              // 错误消息，成功时为空字符串
+    int page_count;                 // pages 数组的长度
+    pdf_page_diagnostic_t* pages;   // 逐页诊断信息，文档未加载时为 NULL
+    size_t scratch_allocations;     // 临时缓冲区向系统申请内存的次数（只取决于最大一页的用量，
+                                    // 不随文本对象数量和命中数增长）
+    size_t scratch_bytes;           // 临时缓冲区向系统申请的总字节数
+    size_t font_loads;              // 替代字体的加载次数（每个文档至多一次，与替换数量无关）
+    size_t fonts_preserved;         // 沿用原对象字体、就地修改原对象的替换数（PDF_FONT_PRESERVE 模式）
+    size_t pages_rewritten;         // 重新生成了内容流的页数（只有被改动的页面才会重写）
+    int passthrough;                // 1 表示没有命中、输出就是原始输入（见 passthrough_on_miss）
+    size_t pages_skipped;           // 预筛选判定没有目标文本、跳过对象枚举的页数（见 page_prefilter），
+                                    // 与 page_count 之比即跳过率
+    pdf_stats_t stats;              // 分阶段耗时与计数
+} pdf_result_t;
+
+// 目标文本的匹配方式
+typedef enum {
+    PDF_MATCH_TEXT_OBJECTS = 0,  // 逐个文本对象提取文本并匹配，只替换对象中的目标文本（默认）
+    PDF_MATCH_TEXT_PAGE = 1      // 使用文本页搜索索引，每页只搜索一次，可以找到跨越多个文本对象的目标，只重写被匹配触及的对象
+} pdf_match_mode_t;
+
+// 替换文本使用的字体
+typedef enum {
+    PDF_FONT_SUBSTITUTE = 0,    // 始终使用替代字体（默认 Arial，或 substitute_font_data 指定的字体）
+    PDF_FONT_PRESERVE = 1       // 原对象的字体包含替换文本的全部字符时就地修改原对象，否则使用替代字体；
+                                // 子集字体中缺失的字符（宽度为 0 或只能画出 .notdef）视为不包含
+} pdf_font_mode_t;
+
+// 输出文档的保存方式
+typedef enum {
+    PDF_SAVE_FULL = 0,          // 重写整个文件（默认）
+    PDF_SAVE_INCREMENTAL = 1    // 增量更新：输出以原始字节原样开头，改动的对象和新的交叉引用表追加在末尾，
+                                // 已有签名覆盖的字节范围保持不变。追加部分的大小与改动量不成正比：
+                                // FPDFPage_GenerateContent 会让 PDFium 解析所有可达的对象，增量保存把它们
+                                // 全部追加，例如 1003 字节的输入会变为 2314 字节（前 1003 字节与输入相同）
+} pdf_save_mode_t;
+
+/**
+ * 自定义内存分配器
+ *
+ * 用于分配输出缓冲区。realloc_fn 的语义与 realloc 相同（ptr 为 NULL 时分配新内存），
+ * 使用自定义分配器时，返回的 PDF 流需要用同一分配器的 free_fn 释放。
+ */
+typedef struct {
+    void* (*realloc_fn)(void* user_data, void* ptr, size_t size);
+    void (*free_fn)(void* user_data, void* ptr);
+    void* user_data;
+} pdf_allocator_t;
+
+/**
+ * 替换选项
+ *
+ * 使用前请调用 pdf_replace_options_init 初始化为默认值；传入 NULL 等价于默认选项。
+ */
+typedef struct {
+    const pdf_allocator_t* allocator;   // 输出缓冲区分配器，NULL 表示使用 realloc/free
+    size_t output_capacity_hint;        // 输出缓冲区初始容量，0 表示按输入大小估算
+    unsigned char* output_buffer;       // 调用方预分配的输出缓冲区，可以为 NULL
+    size_t output_buffer_size;          // output_buffer 的容量
+    size_t write_batch_size;            // 流式输出时合并小块的缓冲区大小，0 表示逐块直接写出
+    pdf_match_mode_t match_mode;        // 目标文本的匹配方式
+    pdf_font_mode_t font_mode;          // 替换文本使用的字体
+    const unsigned char* substitute_font_data;  // 替代字体的 TrueType 数据，NULL 表示使用标准字体 Arial
+    size_t substitute_font_size;        // substitute_font_data 的字节数
+    pdf_save_mode_t save_mode;          // 输出文档的保存方式
+    int passthrough_on_miss;            // 非 0 时未命中不报错：照常加载和扫描每一页，没有命中时跳过保存；
+                                        // 内存输出直接返回输入缓冲区本身（借用，调用方不能释放），
+                                        // 流式输出原样写出输入，结果中 passthrough 为 1
+    int page_prefilter;                 // 非 0 时逐对象匹配前先用文本页搜索检查整页，没有目标文本的页面
+                                        // 不再枚举和读取文本对象（只对 PDF_MATCH_TEXT_OBJECTS 生效）。
+                                        // 注意：文本页搜索可能漏掉逐对象匹配能找到的目标（例如字间距较大时
+                                        // 文本页会在同一对象的字符之间插入生成的空格），这样的页面被直接跳过，
+                                        // 其中真实的命中不会被替换也不会报错，因此默认关闭
+} pdf_replace_options_t;
+
+/**
+ * 一组替换：目标文本、替换文本，以及本次调用中该组的命中次数
+ */
+typedef struct {
+    const char* target_text;        // 要替换的目标文本（UTF-8，不能为空字符串）
+    const char* replacement_text;   // 替换用的新文本（UTF-8）
+    size_t hits;                    // 替换的目标文本处数（输出）
+} pdf_replacement_t;
+
+/**
+ * 搜索得到的一处目标文本
+ *
+ * 字符范围的单位取决于匹配方式：PDF_MATCH_TEXT_OBJECTS 下是对象文本中的 UTF-16 代码单元编号，
+ * PDF_MATCH_TEXT_PAGE 下是文本页中的字符编号（匹配可以跨越多个对象，object_index 为开头所在的对象）。
+ */
+typedef struct {
+    int page_index;         // 页码（从 0 开始）
+    int object_index;       // 页面对象编号（与 FPDFPage_GetObject 一致），-1 表示匹配开头不属于任何对象
+    int target_index;       // 命中的目标在 targets 中的编号
+    int char_start;         // 匹配的起始位置
+    int char_count;         // 匹配的长度
+    float left;             // 对象的边界框（页面坐标，来自 FPDFPageObj_GetBounds）
+    float bottom;
+    float right;
+    float top;
+} pdf_search_hit_t;
+
+/**
+ * 流式输出回调
+ *
+ * PDFium 每生成一块数据就调用一次，data 只在回调期间有效。
+ *
+ * @param user_data  调用方提供的用户数据
+ * @param data  本次写出的数据
+ * @param size  数据大小
+ * @return  成功返回非 0，返回 0 会中止保存
+ */
+typedef int (*pdf_write_callback_t)(void* user_data, const void* data, size_t size);
+
+/**
+ * 按需读取输入的回调
+ *
+ * PDFium 解析到某个对象时才读取对应的字节，因此输入不需要完整地位于内存中。
+ * 调用发生在 PDFium 的内部锁中，同一次替换调用内不会并发。
+ *
+ * @param user_data  调用方提供的用户数据
+ * @param position  读取的起始偏移
+ * @param buffer  输出缓冲区
+ * @param size  要读取的字节数，position + size 不会超过输入大小
+ * @return  成功返回非 0，返回 0 表示读取失败
+ */
+typedef int (*pdf_read_callback_t)(void* user_data, size_t position, unsigned char* buffer, size_t size);
+
+/**
+ * 输入读取器：输入的总大小和读取回调
+ */
+typedef struct {
+    size_t size;                // 输入的总字节数
+    pdf_read_callback_t read;   // 读取回调
+    void* user_data;            // 传给读取回调的用户数据
+} pdf_reader_t;
+
+/**
+ * PDF 处理引擎句柄
+ *
+ * 引擎在创建时初始化一次 PDFium 库，并在销毁前保持其状态（字体缓存、CMap 等），
+ * 因此在同一引擎上的多次替换调用无需重复初始化和销毁库。
+ */
+typedef struct pdf_engine pdf_engine_t;
+
 /**
  * 获取最后一次错误的代码
  *
+ * 错误状态是线程局部的，只反映当前线程最近一次调用的结果。
+ *
  * @return 错误代码
  */
 pdf_error_code_t get_last_error(void);
@@ -48,4 +241,253 @@ unsigned char* replace_text_in_pdf_stream(
     size_t* modified_pdf_size
 );
 
-#endif // PDF_PROCESSOR_H
\ No newline at end of file
+/**
+ * 释放结果结构中分配的内存
+ *
+ * @param result  由替换函数填充的结果结构，可以为 NULL
+ */
+void pdf_result_free(pdf_result_t* result);
+
+/**
+ * 将替换选项初始化为默认值
+ *
+ * @param options  要初始化的选项
+ */
+void pdf_replace_options_init(pdf_replace_options_t* options);
+
+/**
+ * 创建 PDF 处理引擎
+ *
+ * 引擎持有 PDFium 库的一次初始化，直到 pdf_engine_destroy 被调用。
+ *
+ * @return  引擎句柄，如果失败则返回 NULL
+ */
+pdf_engine_t* pdf_engine_create(void);
+
+/**
+ * 销毁 PDF 处理引擎
+ *
+ * 当没有其他引擎或调用仍在使用 PDFium 库时，库会在此处被销毁。
+ *
+ * @param engine  由 pdf_engine_create 创建的引擎，可以为 NULL
+ */
+void pdf_engine_destroy(pdf_engine_t* engine);
+
+/**
+ * 使用引擎在 PDF 二进制流中替换文本
+ *
+ * 行为与 replace_text_in_pdf_stream 相同，但复用引擎已初始化的 PDFium 库。
+ * 该函数可以在多个线程中并发调用：每次调用的状态都保存在自己的上下文中，
+ * 而 PDFium 本身不是线程安全的，因此对 PDFium 的访问会在内部串行化。
+ *
+ * 修改后的文档直接写入内存缓冲区，不经过临时文件。如果 options 提供了
+ * output_buffer 且容量足够，返回值就是该缓冲区；否则返回由分配器分配的新缓冲区
+ * （已写入 output_buffer 的内容会被复制过去），调用方需要负责释放。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param pdf_binary_stream  原始 PDF 二进制流
+ * @param pdf_stream_size  原始流大小
+ * @param target_text  要替换的目标文本
+ * @param replacement_text  替换用的新文本
+ * @param modified_pdf_size  修改后的 PDF 流大小（输出参数）
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  修改后的 PDF 二进制流，如果失败则返回 NULL
+ */
+unsigned char* pdf_engine_replace_text(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+);
+
+/**
+ * 使用引擎在一次文档处理中完成多组替换
+ *
+ * 文档只加载、遍历和保存一次；每个文本对象只扫描一次，同时匹配所有目标文本。
+ * 对象中的每处目标都被替换，前后未被匹配的文本保持不变；匹配重叠时使用最靠左的匹配
+ * （同一位置取最长的目标）。函数返回后，每组的 hits 字段包含该组替换的目标文本处数。
+ * 所有组都没有命中时返回 NULL，错误代码为 PDF_ERROR_NO_TEXT_FOUND。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param pdf_binary_stream  原始 PDF 二进制流
+ * @param pdf_stream_size  原始流大小
+ * @param replacements  替换组数组
+ * @param replacement_count  替换组数量
+ * @param modified_pdf_size  修改后的 PDF 流大小（输出参数）
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  修改后的 PDF 二进制流，如果失败则返回 NULL
+ */
+unsigned char* pdf_engine_replace_batch(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+);
+
+/**
+ * 使用引擎替换文本，并把修改后的 PDF 流式写入回调
+ *
+ * 与 pdf_engine_replace_text 相同，但输出不会在内存中完整保留：PDFium 生成的每一块
+ * 数据都直接交给 write_callback。设置 options->write_batch_size 后，小于该大小的块
+ * 会先合并再写出。未找到目标文本时不会写出任何数据。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param pdf_binary_stream  原始 PDF 二进制流
+ * @param pdf_stream_size  原始流大小
+ * @param target_text  要替换的目标文本
+ * @param replacement_text  替换用的新文本
+ * @param write_callback  输出回调
+ * @param user_data  传给输出回调的用户数据
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  错误代码，成功时为 PDF_SUCCESS
+ */
+pdf_error_code_t pdf_engine_replace_text_to_callback(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    pdf_write_callback_t write_callback,
+    void* user_data,
+    pdf_result_t* result
+);
+
+/**
+ * 使用引擎替换文本，并把修改后的 PDF 直接写入文件描述符
+ *
+ * 与 pdf_engine_replace_text_to_callback 相同，输出通过 writev 写入 fd，
+ * 合并缓冲区与下一个大块会在同一次系统调用中写出。保存失败时 fd 中可能已有部分数据。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param pdf_binary_stream  原始 PDF 二进制流
+ * @param pdf_stream_size  原始流大小
+ * @param target_text  要替换的目标文本
+ * @param replacement_text  替换用的新文本
+ * @param fd  已打开的可写文件描述符
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  错误代码，成功时为 PDF_SUCCESS
+ */
+pdf_error_code_t pdf_engine_replace_text_to_fd(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    int fd,
+    pdf_result_t* result
+);
+
+/**
+ * 用文件描述符初始化输入读取器
+ *
+ * 读取使用 pread，不改变 fd 的文件偏移；fd 在使用该读取器的调用结束前必须保持打开。
+ *
+ * @param reader  要初始化的读取器
+ * @param fd  已打开的可读文件描述符（需要支持 pread，例如普通文件）
+ * @return  错误代码，成功时为 PDF_SUCCESS
+ */
+pdf_error_code_t pdf_reader_init_fd(pdf_reader_t* reader, int fd);
+
+/**
+ * 使用引擎从读取器加载文档并完成多组替换
+ *
+ * 与 pdf_engine_replace_batch 相同，但文档通过 FPDF_LoadCustomDocument 按需读取：
+ * 只有被解析到的页面和对象才会读取，大文档不需要完整地读入内存。
+ * 设置 passthrough_on_miss 且没有命中时，输出是输入的副本（不能借用输入缓冲区）。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param reader  输入读取器
+ * @param replacements  替换组数组
+ * @param replacement_count  替换组数量
+ * @param modified_pdf_size  修改后的 PDF 流大小（输出参数）
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  修改后的 PDF 二进制流，如果失败则返回 NULL
+ */
+unsigned char* pdf_engine_replace_batch_from_reader(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const pdf_reader_t* reader,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+);
+
+/**
+ * 使用引擎从读取器加载文档、完成多组替换，并把结果直接写入文件描述符
+ *
+ * 输入按需读取，输出流式写出，两端都不需要完整的文档缓冲区。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  替换选项，可以为 NULL
+ * @param reader  输入读取器
+ * @param replacements  替换组数组
+ * @param replacement_count  替换组数量
+ * @param fd  已打开的可写文件描述符
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  错误代码，成功时为 PDF_SUCCESS
+ */
+pdf_error_code_t pdf_engine_replace_batch_from_reader_to_fd(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const pdf_reader_t* reader,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    int fd,
+    pdf_result_t* result
+);
+
+/**
+ * 使用引擎只搜索目标文本，不修改也不保存文档
+ *
+ * 扫描方式与 pdf_engine_replace_batch 相同（match_mode、page_prefilter 等选项都生效），
+ * 但不会重写任何对象、调用 FPDFPage_GenerateContent 或保存文档。
+ * 命中按页码排列，同一页内按对象编号（文本页模式下按文本顺序）排列。
+ * 没有命中时返回 PDF_SUCCESS，*hits 为 NULL，*hit_count 为 0。
+ *
+ * @param engine  PDF 处理引擎
+ * @param options  扫描选项，可以为 NULL
+ * @param pdf_binary_stream  PDF 二进制流
+ * @param pdf_stream_size  流大小
+ * @param targets  目标文本数组（UTF-8，不能为空字符串）
+ * @param target_count  目标文本数量
+ * @param hits  命中数组（输出参数），用 pdf_search_hits_free 释放
+ * @param hit_count  命中数量（输出参数）
+ * @param result  本次调用的结果与逐页诊断（输出参数，可以为 NULL）
+ * @return  错误代码，成功时为 PDF_SUCCESS
+ */
+pdf_error_code_t pdf_engine_search(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* const* targets,
+    size_t target_count,
+    pdf_search_hit_t** hits,
+    size_t* hit_count,
+    pdf_result_t* result
+);
+
+/**
+ * 释放 pdf_engine_search 返回的命中数组
+ *
+ * @param hits  命中数组，可以为 NULL
+ */
+void pdf_search_hits_free(pdf_search_hit_t* hits);
+
+#endif // PDF_PROCESSOR_H
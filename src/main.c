@@ -1,78 +1,165 @@
+#define _XOPEN_SOURCE 700  // 需要 realpath
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/pdf_handler.h"
 
-#define MAX_FILE_SIZE 10485760  // 10 MB
+#define WRITE_BATCH_SIZE 65536  // 合并小块输出的缓冲区大小
+
+// 只读映射的输入文件
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    dev_t device;   // 用于检查输出是否就是输入文件
+    ino_t inode;
+} mapped_file_t;
 
 /**
- * 读取文件内容
- * 
- * 该函数将文件内容读取到内存中，并将文件大小写入 file_size 中。
- * 如果读取失败，会返回 NULL。
- * 
+ * 以只读方式映射输入文件
+ *
+ * 文件内容不复制到堆上，PDFium 直接读取映射的页面，按需从页缓存换入，
+ * 因此不再限制文件大小，常驻内存也只包含实际访问过的页面。
+ * 解析会顺序扫描交叉引用表和对象，所以提示内核按顺序预读。
+ *
  * @param filename 文件名
- * @param file_size 文件大小（输出参数）
- * @return 文件内容
+ * @param file     映射结果（输出参数）
+ * @return 成功返回 0，失败返回 -1
  */
-unsigned char* read_file(const char* filename, size_t* file_size) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) {
+static int map_file(const char* filename, mapped_file_t* file) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
         perror("Error opening file");
-        return NULL;
+        return -1;
     }
 
-    fseek(file, 0, SEEK_END);
-    *file_size = ftell(file);
-    rewind(file);
-
-    if (*file_size > MAX_FILE_SIZE) {
-        fprintf(stderr, "File too large\n");
-        fclose(file);
-        return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        perror("Error reading file");
+        close(fd);
+        return -1;
     }
-
-    unsigned char* buffer = (unsigned char*)malloc(*file_size);
-    if (!buffer) {
-        perror("Memory allocation failed");
-        fclose(file);
-        return NULL;
+    if (!S_ISREG(st.st_mode) || st.st_size <= 0) {
+        fprintf(stderr, "Input is not a non-empty regular file\n");
+        close(fd);
+        return -1;
     }
 
-    size_t read_size = fread(buffer, 1, *file_size, file);
-    if (read_size != *file_size) {
-        perror("Error reading file");
-        free(buffer);
-        fclose(file);
-        return NULL;
+    file->size = (size_t)st.st_size;
+    file->device = st.st_dev;
+    file->inode = st.st_ino;
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // 映射建立后描述符不再需要
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping file");
+        return -1;
     }
 
-    fclose(file);
-    return buffer;
+    // 提示只是优化，失败时忽略
+    posix_madvise(data, file->size, POSIX_MADV_SEQUENTIAL);
+    posix_madvise(data, file->size, POSIX_MADV_WILLNEED);
+
+    file->data = (unsigned char*)data;
+    return 0;
+}
+
+// 解除输入文件的映射
+static void unmap_file(mapped_file_t* file) {
+    munmap(file->data, file->size);
+    file->data = NULL;
+    file->size = 0;
+}
+
+// 写入中的输出文件：先写到目标所在目录的临时文件，成功后再替换目标文件
+typedef struct {
+    char* target_path;  // 被替换的文件：输出路径是符号链接时为链接指向的文件
+    char* temp_path;
+    int fd;
+} output_file_t;
+
+static void free_output_paths(output_file_t* output) {
+    free(output->target_path);
+    free(output->temp_path);
 }
 
 /**
- * 将二进制数据写入到文件中
- * 
- * 该函数将 data 中的 size 字节写入到 filename 指定的文件中。
- * 如果写入成功，返回 1，否则返回 0。
- * 
- * @param filename 文件名
- * @param data 要写入的数据
- * @param size 数据大小
- * @return 写入是否成功
+ * 在输出文件所在目录创建临时文件
+ *
+ * 临时文件与目标在同一目录（同一文件系统），rename 才是原子的。
+ * 目标文件在替换成功之前保持不变。输出路径是符号链接时替换链接指向的文件，
+ * 链接本身保留；目标文件已存在时临时文件沿用它的权限位。
+ *
+ * @param filename 输出文件名
+ * @param output   临时文件（输出参数）
+ * @return 成功返回 0，失败返回 -1
  */
-int write_file(const char* filename, const unsigned char* data, size_t size) {
-    FILE* file = fopen(filename, "wb");
-    if (!file) {
+static int open_output(const char* filename, output_file_t* output) {
+    // 目标不存在时 realpath 失败，直接使用输出路径
+    output->target_path = realpath(filename, NULL);
+    if (!output->target_path) output->target_path = strdup(filename);
+    if (!output->target_path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    size_t length = strlen(output->target_path);
+    output->temp_path = (char*)malloc(length + sizeof(".XXXXXX"));
+    if (!output->temp_path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(output->target_path);
+        return -1;
+    }
+    memcpy(output->temp_path, output->target_path, length);
+    memcpy(output->temp_path + length, ".XXXXXX", sizeof(".XXXXXX"));
+
+    output->fd = mkstemp(output->temp_path);
+    if (output->fd < 0) {
         perror("Error opening file for writing");
-        return 0;
+        free_output_paths(output);
+        return -1;
     }
 
-    size_t written = fwrite(data, 1, size, file);
-    fclose(file);
+    // mkstemp 以 0600 创建：沿用已有目标文件的权限，没有时与直接创建文件相同
+    struct stat target_stat;
+    mode_t mode;
+    if (stat(output->target_path, &target_stat) == 0) {
+        mode = target_stat.st_mode & 07777;
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0644 & ~mask;
+    }
+    fchmod(output->fd, mode);
+    return 0;
+}
+
+// 放弃临时文件，目标文件保持不变
+static void discard_output(output_file_t* output) {
+    close(output->fd);
+    unlink(output->temp_path);
+    free_output_paths(output);
+}
 
-    return (written == size);
+// 关闭临时文件并替换目标文件，失败时放弃临时文件
+static int commit_output(output_file_t* output) {
+    if (fsync(output->fd) != 0 || close(output->fd) != 0) {
+        perror("Error writing file");
+        unlink(output->temp_path);
+        free_output_paths(output);
+        return -1;
+    }
+    if (rename(output->temp_path, output->target_path) != 0) {
+        perror("Error renaming file");
+        unlink(output->temp_path);
+        free_output_paths(output);
+        return -1;
+    }
+    free_output_paths(output);
+    return 0;
 }
 
 /**
@@ -84,9 +171,11 @@ int write_file(const char* filename, const unsigned char* data, size_t size) {
  *  target_text:要在 PDF 中搜索和替换的文本
  *  replacement_text:将 target_text 替换为的新文本
  *
- * 该函数从输入 PDF 文件中读取内容，使用 replace_text_in_pdf_stream
- * 函数将 target_text 替换为 replacement_text，最后将结果写入到输出
- * PDF 文件中。
+ * 该函数将输入 PDF 文件映射到内存，使用 pdf_engine_replace_text_to_fd
+ * 函数将 target_text 替换为 replacement_text，结果直接流式写入输出
+ * PDF 文件所在目录的临时文件，不会在内存中完整保留。成功后临时文件
+ * 替换输出文件（符号链接替换其指向的文件，已有文件的权限位保留）；
+ * 失败时删除临时文件，已有的输出文件保持不变。
  *
  * @param argc  argc
  * @param argv  argv
@@ -103,42 +192,67 @@ int main(int argc, char* argv[]) {
     const char* target_text = argv[3];      // 要在 PDF 中搜索和替换的文本
     const char* replacement_text = argv[4]; // 将 target_text 替换为的新文本
 
-    // 读取输入 PDF 文件
-    size_t pdf_size;
-    unsigned char* pdf_content = read_file(input_filename, &pdf_size);
-    if (!pdf_content) {
+    // 映射输入 PDF 文件
+    mapped_file_t input;
+    if (map_file(input_filename, &input) != 0) {
+        return 1;
+    }
+
+    // 输出就是输入文件（包括通过链接指向同一文件）时拒绝处理
+    struct stat output_stat;
+    if (stat(output_filename, &output_stat) == 0 &&
+        output_stat.st_dev == input.device && output_stat.st_ino == input.inode) {
+        fprintf(stderr, "Output file must be different from the input file\n");
+        unmap_file(&input);
+        return 1;
+    }
+
+    pdf_engine_t* engine = pdf_engine_create();
+    if (!engine) {
+        fprintf(stderr, "Failed to initialize PDF engine.\n");
+        unmap_file(&input);
+        return 1;
+    }
+
+    output_file_t output;
+    if (open_output(output_filename, &output) != 0) {
+        pdf_engine_destroy(engine);
+        unmap_file(&input);
         return 1;
     }
 
-    // 将目标文本替换为新文本
-    size_t modified_size;
-    unsigned char* result = replace_text_in_pdf_stream(
-        pdf_content,
-        pdf_size,
+    // 将目标文本替换为新文本，结果直接写入临时文件
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.write_batch_size = WRITE_BATCH_SIZE;
+
+    pdf_error_code_t code = pdf_engine_replace_text_to_fd(
+        engine,
+        &options,
+        input.data,
+        input.size,
         target_text,
         replacement_text,
-        &modified_size
+        output.fd,
+        NULL
     );
 
-    // 释放原始 PDF 内容
-    free(pdf_content);
+    // 解除输入文件的映射
+    unmap_file(&input);
+    pdf_engine_destroy(engine);
 
-    // 如果替换失败，返回错误
-    if (result == NULL) {
-        fprintf(stderr, "Failed to replace text in PDF.\n");
+    // 如果替换失败，删除临时文件并返回错误，不改动已有的输出文件
+    if (code != PDF_SUCCESS) {
+        const char* message = get_last_error_message();
+        fprintf(stderr, "Failed to replace text in PDF: %s\n", message ? message : "unknown error");
+        discard_output(&output);
         return 1;
     }
-
-    // 将结果写入到输出 PDF 文件中
-    if (!write_file(output_filename, result, modified_size)) {
+    if (commit_output(&output) != 0) {
         fprintf(stderr, "Failed to write output file.\n");
-        free(result);
         return 1;
     }
 
-    // 释放结果内存
-    free(result);
-
     printf("Text replacement completed. Output written to %s\n", output_filename);
 
     return 0;
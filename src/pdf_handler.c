@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <fpdfview.h>
 #include <fpdf_edit.h>
 #include <fpdf_text.h>
@@ -6,15 +7,137 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
+#endif
 #include "../include/pdf_handler.h"
+#include "utf_transcode.h"
 
-// 全局错误信息
-static pdf_error_code_t g_last_error_code = PDF_SUCCESS;
-static char g_last_error_message[256] = "";
+// 最后一次错误信息（线程局部，仅用于兼容 get_last_error 接口）
+static _Thread_local pdf_error_code_t g_last_error_code = PDF_SUCCESS;
+static _Thread_local char g_last_error_message[256] = "";
 
-// 用于文件写入的全局变量
-static FILE* g_output_file = NULL;
+// PDFium 不是线程安全的：库的初始化/销毁以及所有文档操作都在这把锁内进行
+static pthread_mutex_t g_pdfium_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// PDFium 库的引用计数：由引擎句柄和一次性调用共享，计数归零时才销毁库
+static int g_library_refs = 0;
+
+// PDF 处理引擎：持有一次 PDFium 库初始化，使字体缓存和 CMap 在多次调用间保持有效
+struct pdf_engine {
+    int library_acquired;
+};
+
+// 暂存区的一个内存块，块内按顺序分配
+typedef struct arena_chunk {
+    struct arena_chunk* next;   // 下一个块（回退后保留，供后续分配复用）
+    size_t capacity;            // 块的数据容量
+    size_t used;                // 已分配的字节数
+    unsigned char data[];
+} arena_chunk_t;
+
+// 单次调用的暂存区：替换路径上的临时缓冲区都从这里按顺序分配，
+// 通过 arena_mark/arena_rewind 回退，调用结束时一次性释放
+typedef struct {
+    arena_chunk_t* first;       // 第一个块
+    arena_chunk_t* current;     // 当前分配所在的块
+    size_t chunk_allocations;   // 向系统申请块的次数
+    size_t chunk_bytes;         // 向系统申请的总字节数
+} scratch_arena_t;
+
+// 暂存区的回退点
+typedef struct {
+    arena_chunk_t* chunk;
+    size_t used;
+} arena_mark_t;
+
+// 单个原字体的字符覆盖检查结果
+typedef struct {
+    FPDF_FONT font;             // 原对象的字体（由文档持有）
+    unsigned char* bmp;         // BMP 字符的检查结果：0 未检查，1 包含，2 不包含；NULL 表示不缓存
+} font_coverage_t;
+
+// 单个文档的字体缓存：替代字体只解析一次，之后的替换复用同一个 FPDF_FONT 句柄；
+// 原字体的字符覆盖检查按字体缓存，每个字体的每个字符只检查一次
+typedef struct {
+    FPDF_FONT substitute;       // 替代字体，第一次需要时加载
+    int substitute_failed;      // 替代字体加载失败，不再重试
+    size_t loads;               // 加载字体的次数
+    size_t preserved;           // 沿用原字体的替换数
+    font_coverage_t* coverage;  // 按字体缓存的覆盖检查结果
+    int coverage_count;
+    int coverage_capacity;
+} font_cache_t;
+
+// 只搜索时收集的命中
+typedef struct {
+    pdf_search_hit_t* hits;
+    size_t count;
+    size_t capacity;
+} search_hits_t;
+
+typedef struct pattern_matcher pattern_matcher_t;
+
+// 单次替换调用的上下文：错误信息和诊断都写在这里，不依赖任何全局状态
+typedef struct {
+    const pdf_replace_options_t* options;       // 调用方提供的选项，可以为 NULL
+    pdf_result_t* result;                       // 调用方提供的结果结构，可以为 NULL
+    const pdf_reader_t* reader;                 // 按需读取的输入，NULL 表示输入完整位于内存中
+    FPDF_FILEACCESS file_access;                // reader 对应的 PDFium 读取接口，文档关闭前必须有效
+    pdf_replacement_t* replacements;            // 本次调用的替换组
+    size_t replacement_count;                   // 替换组数量
+    unsigned short* const* replacements_utf16;  // 各组替换文本的 UTF-16LE 形式
+    unsigned short* const* targets_utf16;       // 各组目标文本的 UTF-16LE 形式
+    const pattern_matcher_t* matcher;           // 所有目标文本的匹配器
+    pdf_match_mode_t match_mode;                // 匹配方式
+    pdf_font_mode_t font_mode;                  // 替换文本使用的字体
+    int page_prefilter;                         // 枚举对象前先用文本页搜索筛掉没有目标文本的页面
+    font_cache_t fonts;                         // 当前文档的字体缓存，调用方需持有 g_pdfium_lock
+    size_t pages_rewritten;                     // 重新生成了内容流的页数
+    size_t pages_skipped;                       // 预筛选跳过对象枚举的页数
+    int passthrough;                            // 没有命中，输出就是原始输入
+    search_hits_t* search;                      // 只搜索时收集命中，不修改和保存文档；NULL 表示替换
+    pdf_stats_t stats;                          // 分阶段耗时与计数，调用结束时复制到 result
+    scratch_arena_t arena;                      // 本次调用的暂存区
+} replace_context_t;
+
+// 写入内存的 FPDF_FILEWRITE 实现：按需几何增长，一次写出整个文档
+typedef struct {
+    FPDF_FILEWRITE base;                // 必须是第一个成员，PDFium 回调时会传回该指针
+    const pdf_allocator_t* allocator;   // 分配器，用于增长缓冲区
+    unsigned char* data;                // 输出缓冲区
+    size_t size;                        // 已写入字节数
+    size_t capacity;                    // 缓冲区容量
+    int owns_data;                      // data 是否由分配器分配（否则为调用方提供的缓冲区）
+    size_t allocations;                 // 通过分配器分配或增长缓冲区的次数
+} memory_writer_t;
+
+// 流式 FPDF_FILEWRITE 实现：把 PDFium 的写入块直接转发给回调或文件描述符，
+// 小块可以先合并到批量缓冲区，再与下一个大块一起写出
+typedef struct {
+    FPDF_FILEWRITE base;            // 必须是第一个成员，PDFium 回调时会传回该指针
+    pdf_write_callback_t callback;  // 输出回调，为 NULL 时写入 fd
+    void* user_data;                // 回调的用户数据
+    int fd;                         // 输出文件描述符
+    unsigned char* batch;           // 小块合并缓冲区，为 NULL 表示不合并
+    size_t batch_size;              // 合并缓冲区容量
+    size_t batch_used;              // 合并缓冲区中待写出的字节数
+    size_t bytes_written;           // 已写出的字节数
+    size_t writes;                  // 调用回调或 writev 的次数
+} stream_writer_t;
 
 // 调试日志函数
 static void debug_log(const char* format, ...) {
@@ -23,7 +146,11 @@ static void debug_log(const char* format, ...) {
     char buffer[1024];
     vsnprintf(buffer, sizeof(buffer), format, args);
     va_end(args);
+#ifdef __EMSCRIPTEN__
     emscripten_log(EM_LOG_CONSOLE, "%s", buffer);
+#elif defined(PDF_HANDLER_DEBUG)
+    fprintf(stderr, "%s\n", buffer);
+#endif
 }
 
 // 设置错误信息
@@ -38,6 +165,20 @@ static void set_error(pdf_error_code_t code, const char* message) {
     }
 }
 
+// 设置错误信息，同时写入调用上下文的结果结构
+static void set_context_error(replace_context_t* ctx, pdf_error_code_t code, const char* message) {
+    set_error(code, message);
+    if (ctx && ctx->result) {
+        ctx->result->code = code;
+        if (message) {
+            strncpy(ctx->result->message, message, sizeof(ctx->result->message) - 1);
+            ctx->result->message[sizeof(ctx->result->message) - 1] = '\0';
+        } else {
+            ctx->result->message[0] = '\0';
+        }
+    }
+}
+
 // 获取最后的错误代码
 pdf_error_code_t get_last_error(void) {
     return g_last_error_code;
@@ -48,319 +189,2056 @@ const char* get_last_error_message(void) {
     return g_last_error_message[0] ? g_last_error_message : NULL;
 }
 
+// 释放结果结构中分配的内存
+void pdf_result_free(pdf_result_t* result) {
+    if (!result) return;
+    free(result->pages);
+    result->pages = NULL;
+    result->page_count = 0;
+}
+
+// 初始化 PDFium 库（仅在第一个引用时真正初始化）
+static void acquire_library(void) {
+    pthread_mutex_lock(&g_pdfium_lock);
+    if (g_library_refs++ > 0) {
+        pthread_mutex_unlock(&g_pdfium_lock);
+        return;
+    }
+
+    debug_log("Initializing PDFium library");
+    FPDF_LIBRARY_CONFIG config;
+    config.version = 2;
+    config.m_pUserFontPaths = NULL;
+    config.m_pIsolate = NULL;
+    config.m_v8EmbedderSlot = 0;
+    FPDF_InitLibraryWithConfig(&config);
+    pthread_mutex_unlock(&g_pdfium_lock);
+}
+
+// 释放 PDFium 库引用（最后一个引用释放时销毁库）
+static void release_library(void) {
+    pthread_mutex_lock(&g_pdfium_lock);
+    if (g_library_refs > 0 && --g_library_refs == 0) {
+        debug_log("Destroying PDFium library");
+        FPDF_DestroyLibrary();
+    }
+    pthread_mutex_unlock(&g_pdfium_lock);
+}
+
+// 创建 PDF 处理引擎
+pdf_engine_t* pdf_engine_create(void) {
+    pdf_engine_t* engine = (pdf_engine_t*)calloc(1, sizeof(pdf_engine_t));
+    if (!engine) {
+        set_error(PDF_ERROR_MEMORY_ERROR, "Failed to allocate PDF engine");
+        return NULL;
+    }
+
+    acquire_library();
+    engine->library_acquired = 1;
+    return engine;
+}
+
+// 销毁 PDF 处理引擎
+void pdf_engine_destroy(pdf_engine_t* engine) {
+    if (!engine) return;
+    if (engine->library_acquired) {
+        release_library();
+    }
+    free(engine);
+}
+
+// 默认分配器：直接使用 realloc/free，返回的缓冲区可以直接 free
+static void* default_realloc(void* user_data, void* ptr, size_t size) {
+    (void)user_data;
+    return realloc(ptr, size);
+}
+
+static void default_free(void* user_data, void* ptr) {
+    (void)user_data;
+    free(ptr);
+}
+
+static const pdf_allocator_t g_default_allocator = { default_realloc, default_free, NULL };
+
+// 初始化替换选项为默认值
+void pdf_replace_options_init(pdf_replace_options_t* options) {
+    if (!options) return;
+    memset(options, 0, sizeof(*options));
+}
+
+// 初始化内存写入器，优先使用调用方提供的缓冲区
+static void memory_writer_init(memory_writer_t* writer, const pdf_replace_options_t* options,
+                               size_t input_size) {
+    memset(writer, 0, sizeof(*writer));
+    writer->base.version = 1;
+    writer->allocator = (options && options->allocator) ? options->allocator : &g_default_allocator;
+
+    if (options && options->output_buffer && options->output_buffer_size > 0) {
+        writer->data = options->output_buffer;
+        writer->capacity = options->output_buffer_size;
+        writer->owns_data = 0;
+    } else {
+        // 修改后的文档通常与原文档大小相近，预留一些余量以避免多次增长
+        writer->capacity = (options && options->output_capacity_hint > 0)
+                               ? options->output_capacity_hint
+                               : input_size + input_size / 4;
+    }
+}
+
+// 确保写入器至少还能容纳 extra 字节
+static int memory_writer_reserve(memory_writer_t* writer, size_t extra) {
+    size_t required = writer->size + extra;
+    if (required < writer->size) return 0;  // 溢出
+    if (writer->data && required <= writer->capacity) return 1;
+
+    size_t new_capacity = writer->capacity > 0 ? writer->capacity : 4096;
+    while (new_capacity < required) {
+        if (new_capacity > ((size_t)-1) / 2) {
+            new_capacity = required;
+            break;
+        }
+        new_capacity *= 2;
+    }
+
+    unsigned char* new_data;
+    if (writer->owns_data || writer->data == NULL) {
+        new_data = (unsigned char*)writer->allocator->realloc_fn(
+            writer->allocator->user_data, writer->data, new_capacity);
+        if (!new_data) return 0;
+        writer->owns_data = 1;
+    } else {
+        // 调用方提供的缓冲区不够用：转移到分配器分配的缓冲区
+        new_data = (unsigned char*)writer->allocator->realloc_fn(
+            writer->allocator->user_data, NULL, new_capacity);
+        if (!new_data) return 0;
+        memcpy(new_data, writer->data, writer->size);
+        writer->owns_data = 1;
+    }
+
+    writer->data = new_data;
+    writer->capacity = new_capacity;
+    writer->allocations++;
+    return 1;
+}
+
+// 释放写入器持有的缓冲区（调用方提供的缓冲区不会被释放）
+static void memory_writer_release(memory_writer_t* writer) {
+    if (writer->owns_data && writer->data) {
+        writer->allocator->free_fn(writer->allocator->user_data, writer->data);
+    }
+    writer->data = NULL;
+    writer->size = 0;
+    writer->capacity = 0;
+}
+
 // 自定义写入函数
 static int WriteBlockCallback(struct FPDF_FILEWRITE_* pThis, const void* data, unsigned long size) {
-    if (g_output_file == NULL) return 0;
-    return fwrite(data, 1, size, g_output_file) == size;
-}
-
-// 将UTF-16LE字符串转换为UTF-8
-static char* utf16le_to_utf8(const unsigned short* utf16, int len) {
-    if (!utf16 || len <= 0) return NULL;
-    
-    // 预估UTF-8需要的大小（每个UTF-16字符最多需要3个UTF-8字节）
-    int utf8_size = len * 3 + 1;
-    char* utf8 = (char*)malloc(utf8_size);
-    if (!utf8) return NULL;
-    
-    int utf8_len = 0;
-    for (int i = 0; i < len; i++) {
-        unsigned short unicode = utf16[i];
-        
-        if (unicode < 0x80) {
-            // ASCII字符
-            if (utf8_len + 1 >= utf8_size) break;
-            utf8[utf8_len++] = (char)unicode;
-        } else if (unicode < 0x800) {
-            // 2字节UTF-8
-            if (utf8_len + 2 >= utf8_size) break;
-            utf8[utf8_len++] = 0xC0 | (unicode >> 6);
-            utf8[utf8_len++] = 0x80 | (unicode & 0x3F);
-        } else {
-            // 3字节UTF-8
-            if (utf8_len + 3 >= utf8_size) break;
-            utf8[utf8_len++] = 0xE0 | (unicode >> 12);
-            utf8[utf8_len++] = 0x80 | ((unicode >> 6) & 0x3F);
-            utf8[utf8_len++] = 0x80 | (unicode & 0x3F);
+    memory_writer_t* writer = (memory_writer_t*)pThis;
+    if (size == 0) return 1;
+    if (!memory_writer_reserve(writer, size)) return 0;
+    memcpy(writer->data + writer->size, data, size);
+    writer->size += size;
+    return 1;
+}
+
+// 把 iovec 数组完整写入 fd，处理部分写入和 EINTR
+static int write_all_iov(int fd, struct iovec* iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        // 跳过已完整写出的 iovec，调整部分写出的那一个
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
         }
     }
-    utf8[utf8_len] = '\0';
-    return utf8;
+    return 1;
 }
 
-// 将UTF-8字符串转换为UTF-16LE
-static unsigned short* utf8_to_utf16le(const char* utf8, int* out_len) {
-    if (!utf8 || !out_len) return NULL;
-    
-    int utf8_len = strlen(utf8);
-    // 预估UTF-16需要的大小（每个UTF-8字符最多需要1个UTF-16字符）
-    int utf16_size = (utf8_len + 1) * sizeof(unsigned short);
-    unsigned short* utf16 = (unsigned short*)malloc(utf16_size);
-    if (!utf16) return NULL;
-    
-    int utf16_len = 0;
-    int i = 0;
-    while (i < utf8_len) {
-        unsigned int unicode = 0;
-        unsigned char c = utf8[i];
-        
-        if ((c & 0x80) == 0) {
-            // ASCII字符
-            unicode = c;
-            i += 1;
-        } else if ((c & 0xE0) == 0xC0) {
-            // 2字节UTF-8
-            if (i + 1 >= utf8_len) break;
-            unicode = ((c & 0x1F) << 6) | (utf8[i + 1] & 0x3F);
-            i += 2;
-        } else if ((c & 0xF0) == 0xE0) {
-            // 3字节UTF-8
-            if (i + 2 >= utf8_len) break;
-            unicode = ((c & 0x0F) << 12) | 
-                     ((utf8[i + 1] & 0x3F) << 6) |
-                     (utf8[i + 2] & 0x3F);
-            i += 3;
-        } else {
-            // 不支持的编码
-            i += 1;
-            continue;
+// 写出合并缓冲区中的数据，并紧接着写出 data（可以为 NULL）
+static int stream_writer_flush(stream_writer_t* writer, const void* data, size_t size) {
+    int ok = 1;
+    // 只统计写出成功的字节
+    if (writer->callback) {
+        if (writer->batch_used > 0) {
+            ok = writer->callback(writer->user_data, writer->batch, writer->batch_used);
+            writer->writes++;
+            if (ok) writer->bytes_written += writer->batch_used;
+        }
+        if (ok && size > 0) {
+            ok = writer->callback(writer->user_data, data, size);
+            writer->writes++;
+            if (ok) writer->bytes_written += size;
+        }
+    } else {
+        // 合并缓冲区和当前块通过一次 writev 写出
+        struct iovec iov[2];
+        int iovcnt = 0;
+        if (writer->batch_used > 0) {
+            iov[iovcnt].iov_base = writer->batch;
+            iov[iovcnt].iov_len = writer->batch_used;
+            iovcnt++;
+        }
+        if (size > 0) {
+            iov[iovcnt].iov_base = (void*)data;
+            iov[iovcnt].iov_len = size;
+            iovcnt++;
+        }
+        if (iovcnt > 0) {
+            ok = write_all_iov(writer->fd, iov, iovcnt);
+            writer->writes++;
+            if (ok) writer->bytes_written += writer->batch_used + size;
         }
-        
-        if (utf16_len >= utf16_size / sizeof(unsigned short)) break;
-        utf16[utf16_len++] = (unsigned short)unicode;
     }
-    
-    *out_len = utf16_len;
-    return utf16;
+    writer->batch_used = 0;
+    return ok;
 }
 
-unsigned char* replace_text_in_pdf_stream(
-    const unsigned char* pdf_binary_stream,
-    size_t pdf_stream_size,
-    const char* target_text,
-    const char* replacement_text,
-    size_t* modified_pdf_size
-) {
-    debug_log("Starting replace_text_in_pdf_stream");
-    debug_log("Input parameters:");
-    debug_log("- pdf_stream_size: %zu", pdf_stream_size);
-    debug_log("- target_text: %s", target_text ? target_text : "NULL");
-    debug_log("- replacement_text: %s", replacement_text ? replacement_text : "NULL");
+static void stream_writer_release(stream_writer_t* writer) {
+    free(writer->batch);
+    writer->batch = NULL;
+}
 
-    // 参数验证
-    if (pdf_binary_stream == NULL) {
-        set_error(PDF_ERROR_INVALID_PARAMS, "PDF binary stream is NULL");
-        return NULL;
+// 流式写入函数
+static int StreamWriteBlockCallback(struct FPDF_FILEWRITE_* pThis, const void* data, unsigned long size) {
+    stream_writer_t* writer = (stream_writer_t*)pThis;
+    if (size == 0) return 1;
+
+    // 小块先放入合并缓冲区，缓冲区放不下时连同当前块一起写出
+    if (writer->batch && size < writer->batch_size) {
+        if (writer->batch_used + size > writer->batch_size) {
+            if (!stream_writer_flush(writer, NULL, 0)) return 0;
+        }
+        memcpy(writer->batch + writer->batch_used, data, size);
+        writer->batch_used += size;
+        return 1;
     }
-    if (pdf_stream_size == 0) {
-        set_error(PDF_ERROR_INVALID_PARAMS, "PDF stream size is 0");
-        return NULL;
+    return stream_writer_flush(writer, data, size);
+}
+
+// 初始化流式写入器（callback/user_data/fd 由调用方预先设置）
+static int stream_writer_init(stream_writer_t* writer, const pdf_replace_options_t* options) {
+    writer->base.version = 1;
+    writer->base.WriteBlock = StreamWriteBlockCallback;
+    writer->batch = NULL;
+    writer->batch_size = options ? options->write_batch_size : 0;
+    writer->batch_used = 0;
+    writer->bytes_written = 0;
+    writer->writes = 0;
+
+    if (writer->batch_size > 0) {
+        writer->batch = (unsigned char*)malloc(writer->batch_size);
+        if (!writer->batch) return 0;
     }
-    if (target_text == NULL) {
-        set_error(PDF_ERROR_INVALID_PARAMS, "Target text is NULL");
-        return NULL;
+    return 1;
+}
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN 8  // 暂存区只存放字符和指针，按 8 字节对齐即可
+
+static inline size_t arena_align(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+// 从暂存区分配 size 字节，内存不足返回 NULL
+static void* arena_alloc(scratch_arena_t* arena, size_t size) {
+    if (size > ((size_t)-1) / 2) return NULL;  // 对齐和块容量加倍都会溢出
+    size = arena_align(size);
+    if (size == 0) size = ARENA_ALIGN;
+
+    arena_chunk_t* chunk = arena->current;
+    if (chunk && chunk->capacity - chunk->used >= size) {
+        void* ptr = chunk->data + chunk->used;
+        chunk->used += size;
+        return ptr;
     }
-    if (replacement_text == NULL) {
-        set_error(PDF_ERROR_INVALID_PARAMS, "Replacement text is NULL");
-        return NULL;
+
+    // 优先复用回退后空出的下一个块
+    arena_chunk_t* next = chunk ? chunk->next : arena->first;
+    if (next && next->capacity >= size) {
+        next->used = size;
+        arena->current = next;
+        return next->data;
     }
-    if (modified_pdf_size == NULL) {
-        set_error(PDF_ERROR_INVALID_PARAMS, "Modified PDF size pointer is NULL");
-        return NULL;
+
+    // 申请新块，插在当前块之后。新块至少与已申请的总量一样大，块数随峰值用量对数增长
+    size_t capacity = ARENA_CHUNK_SIZE;
+    while (capacity < size || capacity < arena->chunk_bytes) capacity *= 2;
+    arena_chunk_t* fresh = (arena_chunk_t*)malloc(sizeof(arena_chunk_t) + capacity);
+    if (!fresh) return NULL;
+    fresh->next = next;
+    fresh->capacity = capacity;
+    fresh->used = size;
+    if (chunk) {
+        chunk->next = fresh;
+    } else {
+        arena->first = fresh;
     }
+    arena->current = fresh;
+    arena->chunk_allocations++;
+    arena->chunk_bytes += capacity;
+    return fresh->data;
+}
 
-    // 验证 PDF 格式
-    if (pdf_stream_size < 4 || pdf_binary_stream[0] != '%' || pdf_binary_stream[1] != 'P' || 
-        pdf_binary_stream[2] != 'D' || pdf_binary_stream[3] != 'F') {
-        set_error(PDF_ERROR_INVALID_PARAMS, "Invalid PDF format");
-        return NULL;
+// 把暂存区中的 ptr 从 old_size 扩大到 new_size，内容保持不变。ptr 是当前块的最后一次分配且
+// 块内空间足够时原地扩大，否则重新分配并复制，旧空间随回退回收。ptr 为 NULL 时等同于 arena_alloc
+static void* arena_grow(scratch_arena_t* arena, void* ptr, size_t old_size, size_t new_size) {
+    if (!ptr) return arena_alloc(arena, new_size);
+    if (new_size > ((size_t)-1) / 2) return NULL;
+
+    arena_chunk_t* chunk = arena->current;
+    size_t old_aligned = arena_align(old_size);
+    size_t new_aligned = arena_align(new_size);
+    if (chunk && (unsigned char*)ptr + old_aligned == chunk->data + chunk->used &&
+        chunk->capacity - chunk->used >= new_aligned - old_aligned) {
+        chunk->used += new_aligned - old_aligned;
+        return ptr;
     }
 
-    // 重置错误状态
-    set_error(PDF_SUCCESS, NULL);
+    void* grown = arena_alloc(arena, new_size);
+    if (grown) memcpy(grown, ptr, old_size);
+    return grown;
+}
 
-    debug_log("Initializing PDFium library");
-    FPDF_LIBRARY_CONFIG config;
-    config.version = 2;
-    config.m_pUserFontPaths = NULL;
-    config.m_pIsolate = NULL;
-    config.m_v8EmbedderSlot = 0;
-    FPDF_InitLibraryWithConfig(&config);
+static arena_mark_t arena_mark(const scratch_arena_t* arena) {
+    arena_mark_t mark = { arena->current, arena->current ? arena->current->used : 0 };
+    return mark;
+}
 
-    debug_log("Loading PDF document");
-    FPDF_DOCUMENT doc = FPDF_LoadMemDocument(pdf_binary_stream, (int)pdf_stream_size, NULL);
-    if (!doc) {
-        unsigned long error = FPDF_GetLastError();
-        char error_msg[256];
-        snprintf(error_msg, sizeof(error_msg), "Failed to load PDF document (PDFium error: %lu)", error);
-        set_error(PDF_ERROR_LOAD_FAILED, error_msg);
-        FPDF_DestroyLibrary();
-        return NULL;
+// 回退到 mark，之后分配的内存全部失效，但块本身保留复用
+static void arena_rewind(scratch_arena_t* arena, arena_mark_t mark) {
+    if (mark.chunk) {
+        arena->current = mark.chunk;
+        mark.chunk->used = mark.used;
+    } else {
+        arena->current = arena->first;
+        if (arena->first) arena->first->used = 0;
     }
+}
 
-    int page_count = FPDF_GetPageCount(doc);
-    if (page_count <= 0) {
-        set_error(PDF_ERROR_LOAD_FAILED, "PDF document has no pages");
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
-        return NULL;
+static void arena_release(scratch_arena_t* arena) {
+    arena_chunk_t* chunk = arena->first;
+    while (chunk) {
+        arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
     }
+    arena->first = NULL;
+    arena->current = NULL;
+}
 
-    // 将替换文本转换为UTF-16LE
-    int replacement_len = 0;
-    unsigned short* replacement_utf16 = utf8_to_utf16le(replacement_text, &replacement_len);
-    if (!replacement_utf16) {
-        set_error(PDF_ERROR_MEMORY_ERROR, "Failed to convert replacement text to UTF-16");
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
-        return NULL;
+// 将UTF-8字符串转换为UTF-16LE，结果分配在暂存区中
+static unsigned short* utf8_to_utf16le(scratch_arena_t* arena, const char* utf8, int* out_len) {
+    if (!utf8 || !out_len) return NULL;
+
+    size_t utf8_len = strlen(utf8);
+    unsigned short* utf16 = (unsigned short*)arena_alloc(
+        arena, (UTF16_MAX_UNITS_FOR_UTF8(utf8_len) + 1) * sizeof(unsigned short));
+    if (!utf16) return NULL;
+
+    size_t utf16_len = utf8_to_utf16(utf8, utf8_len, utf16);
+    utf16[utf16_len] = 0;  // PDFium 的宽字符串参数要求以 0 结尾
+    *out_len = (int)utf16_len;
+    return utf16;
+}
+
+// 多模式匹配器（Aho–Corasick 自动机）：一次扫描同时查找所有目标文本。
+// 直接在 UTF-16 代码单元上匹配，文本对象的文本无需转码；只为模式中出现过的代码单元
+// 分配字母表编号，转移表是完整的 DFA，每个代码单元一次查表。
+#define MATCHER_PREFILTER_UNITS 8   // 用 SIMD 预筛选的首代码单元种类上限
+
+struct pattern_matcher {
+    int low_class[256];                 // 小于 256 的代码单元 -> 字母表编号，0 表示不出现在任何模式中
+    unsigned short* wide_units;         // 不小于 256 的代码单元（升序）
+    int* wide_classes;                  // wide_units 对应的字母表编号
+    int wide_count;
+    int alphabet_size;                  // 字母表大小（含编号 0）
+    int state_count;                    // 自动机状态数
+    int* transitions;                   // state_count * alphabet_size 的转移表
+    int* match;                         // 每个状态上结束的最长模式编号，-1 表示无
+    size_t* pattern_lengths;            // 各模式的代码单元数
+    size_t max_pattern_length;          // 最长模式的代码单元数
+    unsigned short first_units[MATCHER_PREFILTER_UNITS];  // 各模式的首代码单元（去重）
+    int first_unit_count;               // 首代码单元种类数，超过上限时为 0，表示不预筛选
+};
+
+static void matcher_free(pattern_matcher_t* matcher) {
+    free(matcher->wide_units);
+    free(matcher->wide_classes);
+    free(matcher->transitions);
+    free(matcher->match);
+    free(matcher->pattern_lengths);
+    memset(matcher, 0, sizeof(*matcher));
+}
+
+// 代码单元所属的字母表编号
+static inline int matcher_class(const pattern_matcher_t* matcher, unsigned short unit) {
+    if (unit < 256) return matcher->low_class[unit];
+    int lo = 0, hi = matcher->wide_count - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (matcher->wide_units[mid] == unit) return matcher->wide_classes[mid];
+        if (matcher->wide_units[mid] < unit) lo = mid + 1; else hi = mid - 1;
     }
+    return 0;
+}
 
-    int text_replaced = 0;
-    for (int i = 0; i < page_count; i++) {
-        FPDF_PAGE page = FPDF_LoadPage(doc, i);
-        if (!page) {
-            snprintf(g_last_error_message, sizeof(g_last_error_message),
-                    "Failed to load page %d", i);
-            continue;
-        }
+// 为代码单元分配字母表编号（构建时使用），内存不足返回 -1
+static int matcher_assign_class(pattern_matcher_t* matcher, unsigned short unit, int* capacity) {
+    int existing = matcher_class(matcher, unit);
+    if (existing) return existing;
 
-        FPDF_TEXTPAGE text_page = FPDFText_LoadPage(page);
-        if (!text_page) {
-            FPDF_ClosePage(page);
-            continue;
+    int cls = matcher->alphabet_size++;
+    if (unit < 256) {
+        matcher->low_class[unit] = cls;
+        return cls;
+    }
+    if (matcher->wide_count == *capacity) {
+        int grown = *capacity ? *capacity * 2 : 16;
+        unsigned short* units = (unsigned short*)realloc(matcher->wide_units, grown * sizeof(unsigned short));
+        if (!units) return -1;
+        matcher->wide_units = units;
+        int* classes = (int*)realloc(matcher->wide_classes, grown * sizeof(int));
+        if (!classes) return -1;
+        matcher->wide_classes = classes;
+        *capacity = grown;
+    }
+    // 插入排序，保持 wide_units 升序
+    int pos = matcher->wide_count;
+    while (pos > 0 && matcher->wide_units[pos - 1] > unit) {
+        matcher->wide_units[pos] = matcher->wide_units[pos - 1];
+        matcher->wide_classes[pos] = matcher->wide_classes[pos - 1];
+        pos--;
+    }
+    matcher->wide_units[pos] = unit;
+    matcher->wide_classes[pos] = cls;
+    matcher->wide_count++;
+    return cls;
+}
+
+// 构建匹配器，patterns 中的字符串以 0 结尾且必须非空
+static int matcher_build(pattern_matcher_t* matcher, const unsigned short* const* patterns, size_t count) {
+    memset(matcher, 0, sizeof(*matcher));
+    matcher->alphabet_size = 1;
+
+    size_t total_length = 0;
+    int wide_capacity = 0;
+    for (size_t i = 0; i < count; i++) {
+        for (const unsigned short* unit = patterns[i]; *unit; unit++) {
+            if (matcher_assign_class(matcher, *unit, &wide_capacity) < 0) {
+                matcher_free(matcher);
+                return 0;
+            }
+            total_length++;
         }
 
-        // 获取页面上的所有对象
-        int obj_count = FPDFPage_CountObjects(page);
-        for (int obj_index = 0; obj_index < obj_count; obj_index++) {
-            FPDF_PAGEOBJECT obj = FPDFPage_GetObject(page, obj_index);
-            if (!obj) continue;
-
-            // 检查是否是文本对象
-            if (FPDFPageObj_GetType(obj) == FPDF_PAGEOBJ_TEXT) {
-                unsigned short buffer[1024];  // 假设单个文本对象不会超过1024个字符
-                unsigned long len = FPDFTextObj_GetText(obj, text_page, buffer, sizeof(buffer)/sizeof(buffer[0]));
-                
-                if (len > 0) {
-                    // 将文本转换为UTF-8进行比较
-                    char* obj_text = utf16le_to_utf8(buffer, len);
-                    if (obj_text) {
-                        if (strstr(obj_text, target_text) != NULL) {
-                            // 获取对象的位置和属性
-                            float left = 0, top = 0, right = 0, bottom = 0;
-                            FPDFPageObj_GetBounds(obj, &left, &bottom, &right, &top);
-
-                            // 获取字体大小和颜色
-                            float font_size = 0;
-                            if (!FPDFTextObj_GetFontSize(obj, &font_size)) {
-                                font_size = 12.0f;  // 默认字体大小
-                            }
-
-                            unsigned int R = 0, G = 0, B = 0, A = 255;
-                            int has_color = FPDFPageObj_GetFillColor(obj, &R, &G, &B, &A);
-
-                            // 删除原始对象
-                            FPDFPage_RemoveObject(page, obj);
-
-                            // 创建新的文本对象
-                            FPDF_PAGEOBJECT new_obj = FPDFPageObj_NewTextObj(doc, "Arial", font_size);
-                            if (new_obj) {
-                                // 设置文本内容
-                                if (FPDFText_SetText(new_obj, replacement_utf16)) {
-                                    // 计算垂直中心点，使用它作为基准点
-                                    // float baseline = bottom + (top - bottom) * 0.025f;  // 降低基线位置
-                                    FPDFPageObj_Transform(new_obj, 1.0, 0, 0, 1.0, left, bottom);
-
-                                    // 设置颜色
-                                    if (has_color) {
-                                        FPDFPageObj_SetFillColor(new_obj, R, G, B, A);
-                                    }
-
-                                    // 添加到页面
-                                    FPDFPage_InsertObject(page, new_obj);
-                                    text_replaced = 1;
-                                } else {
-                                    FPDFPageObj_Destroy(new_obj);
-                                }
-                            }
-                        }
-                        free(obj_text);
-                    }
+        // 记录首代码单元，种类太多时放弃预筛选
+        if (matcher->first_unit_count >= 0) {
+            int known = 0;
+            for (int f = 0; f < matcher->first_unit_count; f++) {
+                if (matcher->first_units[f] == patterns[i][0]) known = 1;
+            }
+            if (!known) {
+                if (matcher->first_unit_count < MATCHER_PREFILTER_UNITS) {
+                    matcher->first_units[matcher->first_unit_count++] = patterns[i][0];
+                } else {
+                    matcher->first_unit_count = -1;
                 }
             }
         }
+    }
+    if (matcher->first_unit_count < 0) matcher->first_unit_count = 0;
+
+    int alphabet_size = matcher->alphabet_size;
+    size_t max_states = total_length + 1;
+    matcher->transitions = (int*)malloc(max_states * alphabet_size * sizeof(int));
+    matcher->match = (int*)malloc(max_states * sizeof(int));
+    matcher->pattern_lengths = (size_t*)malloc(count * sizeof(size_t));
+    int* fail = (int*)malloc(max_states * sizeof(int));
+    int* queue = (int*)malloc(max_states * sizeof(int));
+    if (!matcher->transitions || !matcher->match || !matcher->pattern_lengths || !fail || !queue) {
+        free(fail);
+        free(queue);
+        matcher_free(matcher);
+        return 0;
+    }
 
-        // 生成页面内容
-        if (text_replaced) {
-            FPDFPage_GenerateContent(page);
+    // 构建字典树
+    memset(matcher->transitions, -1, max_states * alphabet_size * sizeof(int));
+    matcher->match[0] = -1;
+    matcher->state_count = 1;
+    for (size_t i = 0; i < count; i++) {
+        int state = 0;
+        size_t length = 0;
+        for (const unsigned short* unit = patterns[i]; *unit; unit++, length++) {
+            int* next = &matcher->transitions[state * alphabet_size + matcher_class(matcher, *unit)];
+            if (*next < 0) {
+                *next = matcher->state_count;
+                matcher->match[matcher->state_count] = -1;
+                matcher->state_count++;
+            }
+            state = *next;
+        }
+        // 重复的模式只保留编号最小的一个
+        if (matcher->match[state] < 0) {
+            matcher->match[state] = (int)i;
+        }
+        matcher->pattern_lengths[i] = length;
+        if (length > matcher->max_pattern_length) {
+            matcher->max_pattern_length = length;
         }
+    }
 
-        FPDFText_ClosePage(text_page);
-        FPDF_ClosePage(page);
+    // 广度优先计算失败链接，并把缺失的转移补全为 DFA
+    int head = 0, tail = 0;
+    for (int c = 0; c < alphabet_size; c++) {
+        int* next = &matcher->transitions[c];
+        if (*next < 0) {
+            *next = 0;
+        } else {
+            fail[*next] = 0;
+            queue[tail++] = *next;
+        }
+    }
+    while (head < tail) {
+        int state = queue[head++];
+        // 自身不是模式终点时，继承失败链接上最长的匹配
+        if (matcher->match[state] < 0) {
+            matcher->match[state] = matcher->match[fail[state]];
+        }
+        for (int c = 0; c < alphabet_size; c++) {
+            int* next = &matcher->transitions[state * alphabet_size + c];
+            int fallback = matcher->transitions[fail[state] * alphabet_size + c];
+            if (*next < 0) {
+                *next = fallback;
+            } else {
+                fail[*next] = fallback;
+                queue[tail++] = *next;
+            }
+        }
     }
 
-    free(replacement_utf16);
+    free(fail);
+    free(queue);
+    return 1;
+}
 
-    if (!text_replaced) {
-        set_error(PDF_ERROR_NO_TEXT_FOUND, "Target text not found in document");
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
-        return NULL;
+// 从 text[i] 开始跳到下一个可能是某个模式开头的位置，没有时返回 length。
+// 自动机在初始状态时，其他代码单元都会回到初始状态，因此跳过它们不影响结果。
+static size_t matcher_skip(const pattern_matcher_t* matcher, const unsigned short* text,
+                           size_t i, size_t length) {
+    int count = matcher->first_unit_count;
+    if (count == 0) return i;
+
+#if defined(__SSE2__)
+    __m128i firsts[MATCHER_PREFILTER_UNITS];
+    for (int f = 0; f < count; f++) firsts[f] = _mm_set1_epi16((short)matcher->first_units[f]);
+    for (; i + 8 <= length; i += 8) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(text + i));
+        __m128i hit = _mm_cmpeq_epi16(block, firsts[0]);
+        for (int f = 1; f < count; f++) hit = _mm_or_si128(hit, _mm_cmpeq_epi16(block, firsts[f]));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(hit);
+        if (mask) return i + __builtin_ctz(mask) / 2;
+    }
+#elif defined(__wasm_simd128__)
+    v128_t firsts[MATCHER_PREFILTER_UNITS];
+    for (int f = 0; f < count; f++) firsts[f] = wasm_i16x8_splat((short)matcher->first_units[f]);
+    for (; i + 8 <= length; i += 8) {
+        v128_t block = wasm_v128_load(text + i);
+        v128_t hit = wasm_i16x8_eq(block, firsts[0]);
+        for (int f = 1; f < count; f++) hit = wasm_v128_or(hit, wasm_i16x8_eq(block, firsts[f]));
+        unsigned int mask = (unsigned int)wasm_i16x8_bitmask(hit);
+        if (mask) return i + __builtin_ctz(mask);
     }
+#endif
+    for (; i < length; i++) {
+        for (int f = 0; f < count; f++) {
+            if (text[i] == matcher->first_units[f]) return i;
+        }
+    }
+    return length;
+}
 
-    FILE* temp_file = tmpfile();
-    if (!temp_file) {
-        set_error(PDF_ERROR_SAVE_FAILED, "Failed to create temporary file");
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
-        return NULL;
+// 从 text[from] 开始查找最靠左的匹配（同一起点取最长的模式）
+// 返回模式编号，未找到返回 -1
+static int matcher_find(const pattern_matcher_t* matcher, const unsigned short* text, size_t length,
+                        size_t from, size_t* match_start) {
+    int state = 0;
+    int best = -1;
+    size_t best_start = 0;
+
+    for (size_t i = from; i < length; i++) {
+        if (state == 0) {
+            i = matcher_skip(matcher, text, i, length);
+            if (i >= length) break;
+        }
+
+        // 之后结束的匹配起点都会在 best_start 之后，可以提前结束
+        if (best >= 0 && i + 1 > best_start + matcher->max_pattern_length) break;
+
+        state = matcher->transitions[state * matcher->alphabet_size + matcher_class(matcher, text[i])];
+        int pattern = matcher->match[state];
+        if (pattern >= 0) {
+            size_t start = i + 1 - matcher->pattern_lengths[pattern];
+            if (best < 0 || start < best_start ||
+                (start == best_start && matcher->pattern_lengths[pattern] > matcher->pattern_lengths[best])) {
+                best = pattern;
+                best_start = start;
+            }
+        }
     }
 
-    // 设置全局输出文件
-    g_output_file = temp_file;
+    if (best >= 0 && match_start) {
+        *match_start = best_start;
+    }
+    return best;
+}
 
-    FPDF_FILEWRITE file_write;
-    file_write.version = 1;
-    file_write.WriteBlock = WriteBlockCallback;
+// 单调时钟（毫秒），用于分阶段计时
+static double monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
 
-    if (!FPDF_SaveAsCopy(doc, &file_write, 0)) {
-        set_error(PDF_ERROR_SAVE_FAILED, "Failed to save modified PDF");
-        g_output_file = NULL;
-        fclose(temp_file);
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
-        return NULL;
+// 加载页面并计入统计，调用方需持有 g_pdfium_lock
+static FPDF_PAGE load_page(pdf_stats_t* stats, FPDF_DOCUMENT doc, int page_index) {
+    double start = monotonic_ms();
+    FPDF_PAGE page = FPDF_LoadPage(doc, page_index);
+    stats->page_load_ms += monotonic_ms() - start;
+    if (page) stats->pages_loaded++;
+    return page;
+}
+
+// 加载文本页并计入统计，调用方需持有 g_pdfium_lock
+static FPDF_TEXTPAGE load_text_page(pdf_stats_t* stats, FPDF_PAGE page) {
+    double start = monotonic_ms();
+    FPDF_TEXTPAGE text_page = FPDFText_LoadPage(page);
+    stats->text_page_ms += monotonic_ms() - start;
+    return text_page;
+}
+
+// FPDF_FILEACCESS 的读取回调：转发给调用方的 reader
+static int reader_get_block(void* param, unsigned long position, unsigned char* buffer, unsigned long size) {
+    const pdf_reader_t* reader = (const pdf_reader_t*)param;
+    if (position > reader->size || size > reader->size - position) return 0;
+    return reader->read(reader->user_data, position, buffer, size);
+}
+
+// 文件描述符读取器：用 pread 读取，不改变 fd 的偏移
+static int fd_reader_read(void* user_data, size_t position, unsigned char* buffer, size_t size) {
+    int fd = (int)(intptr_t)user_data;
+    while (size > 0) {
+        ssize_t n = pread(fd, buffer, size, (off_t)position);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        buffer += n;
+        position += (size_t)n;
+        size -= (size_t)n;
     }
+    return 1;
+}
 
-    // 清除全局输出文件
-    g_output_file = NULL;
+pdf_error_code_t pdf_reader_init_fd(pdf_reader_t* reader, int fd) {
+    if (!reader || fd < 0) {
+        set_error(PDF_ERROR_INVALID_PARAMS, "Invalid reader or file descriptor");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
 
-    fseek(temp_file, 0, SEEK_END);
-    *modified_pdf_size = ftell(temp_file);
-    rewind(temp_file);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        set_error(PDF_ERROR_LOAD_FAILED, "Failed to determine input file size");
+        return PDF_ERROR_LOAD_FAILED;
+    }
 
-    unsigned char* result = (unsigned char*)malloc(*modified_pdf_size);
-    if (!result) {
-        set_error(PDF_ERROR_MEMORY_ERROR, "Failed to allocate memory for result");
-        fclose(temp_file);
-        FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
+    reader->size = (size_t)st.st_size;
+    reader->read = fd_reader_read;
+    reader->user_data = (void*)(intptr_t)fd;
+    return PDF_SUCCESS;
+}
+
+// 从 reader 读取输入的一段字节，调用方需持有 g_pdfium_lock 或保证 reader 可以并发调用
+static int read_input(replace_context_t* ctx, const unsigned char* pdf_binary_stream, size_t position,
+                      unsigned char* buffer, size_t size) {
+    if (!ctx->reader) {
+        memcpy(buffer, pdf_binary_stream + position, size);
+        return 1;
+    }
+    return ctx->reader->read(ctx->reader->user_data, position, buffer, size);
+}
+
+// 加载文档并为每一页准备诊断信息，调用方需持有 g_pdfium_lock
+static FPDF_DOCUMENT load_document_locked(
+    replace_context_t* ctx,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    int* page_count_out
+) {
+    debug_log("Loading PDF document");
+    double start = monotonic_ms();
+    FPDF_DOCUMENT doc;
+    if (ctx->reader) {
+        // 按需读取：PDFium 只在解析到某个对象时才通过回调读取对应的字节
+        ctx->file_access.m_FileLen = (unsigned long)pdf_stream_size;
+        ctx->file_access.m_GetBlock = reader_get_block;
+        ctx->file_access.m_Param = (void*)ctx->reader;
+        doc = FPDF_LoadCustomDocument(&ctx->file_access, NULL);
+    } else {
+        // 64 位长度的接口：映射的大文件可能超过 2 GiB，不能截断为 int
+        doc = FPDF_LoadMemDocument64(pdf_binary_stream, pdf_stream_size, NULL);
+    }
+    ctx->stats.load_ms += monotonic_ms() - start;
+    if (!doc) {
+        unsigned long error = FPDF_GetLastError();
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "Failed to load PDF document (PDFium error: %lu)", error);
+        set_context_error(ctx, PDF_ERROR_LOAD_FAILED, error_msg);
         return NULL;
     }
 
-    if (fread(result, 1, *modified_pdf_size, temp_file) != *modified_pdf_size) {
-        set_error(PDF_ERROR_SAVE_FAILED, "Failed to read modified PDF");
-        free(result);
-        fclose(temp_file);
+    int page_count = FPDF_GetPageCount(doc);
+    if (page_count <= 0) {
+        set_context_error(ctx, PDF_ERROR_LOAD_FAILED, "PDF document has no pages");
         FPDF_CloseDocument(doc);
-        FPDF_DestroyLibrary();
         return NULL;
     }
 
-    fclose(temp_file);
-    FPDF_CloseDocument(doc);
-    FPDF_DestroyLibrary();
+    // 为每一页准备诊断信息
+    if (ctx->result) {
+        pdf_page_diagnostic_t* diagnostics =
+            (pdf_page_diagnostic_t*)calloc(page_count, sizeof(pdf_page_diagnostic_t));
+        if (!diagnostics) {
+            set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to allocate page diagnostics");
+            FPDF_CloseDocument(doc);
+            return NULL;
+        }
+        for (int i = 0; i < page_count; i++) {
+            diagnostics[i].page_index = i;
+            diagnostics[i].status = PDF_PAGE_OK;
+        }
+        ctx->result->pages = diagnostics;
+        ctx->result->page_count = page_count;
+    }
+
+    *page_count_out = page_count;
+    return doc;
+}
+
+// 返回某一页的诊断信息，未请求诊断时返回 NULL
+static pdf_page_diagnostic_t* page_diagnostic(replace_context_t* ctx, int page_index) {
+    return ctx->result && ctx->result->pages ? &ctx->result->pages[page_index] : NULL;
+}
+
+#define TEXT_SCRATCH_UNITS 256  // 读取文本对象的缓冲区初始容量（代码单元数）
+
+// 读取文本对象用的 UTF-16 缓冲区，分配在暂存区中。容量不够时从暂存区重新分配，
+// 旧缓冲区随暂存区回退一并回收，因此扩容不会向系统申请内存
+typedef struct {
+    unsigned short* data;
+    unsigned long capacity;     // 容量（代码单元数）
+} text_scratch_t;
+
+// 读取文本对象的文本到暂存缓冲区，返回代码单元数（不含结尾的 0），内存不足返回 -1。
+// FPDFTextObj_GetText 的长度以字节计且包含结尾的 0；缓冲区不够时它不写入并返回所需长度，
+// 此时按倍数扩容后再取一次，因此不会截断，缓冲区够大时也只调用一次。
+static long read_text_object(FPDF_PAGEOBJECT obj, FPDF_TEXTPAGE text_page, scratch_arena_t* arena,
+                             text_scratch_t* scratch) {
+    unsigned long bytes = FPDFTextObj_GetText(obj, text_page, scratch->data,
+                                              scratch->capacity * sizeof(unsigned short));
+    if (bytes < sizeof(unsigned short)) return 0;
+
+    unsigned long units = bytes / sizeof(unsigned short);
+    if (units > scratch->capacity) {
+        unsigned long capacity = scratch->capacity ? scratch->capacity : TEXT_SCRATCH_UNITS;
+        while (capacity < units) capacity *= 2;
+        // 旧内容会被重新读取，不需要复制
+        unsigned short* grown = (unsigned short*)arena_alloc(arena, capacity * sizeof(unsigned short));
+        if (!grown) return -1;
+        scratch->data = grown;
+        scratch->capacity = capacity;
+
+        bytes = FPDFTextObj_GetText(obj, text_page, scratch->data, capacity * sizeof(unsigned short));
+        if (bytes < sizeof(unsigned short) || bytes / sizeof(unsigned short) > capacity) return 0;
+        units = bytes / sizeof(unsigned short);
+    }
+    return (long)units - 1;
+}
+
+// 获取文档的替代字体，第一次调用时加载：调用方提供了字体数据时加载该 TrueType 字体，
+// 否则使用标准字体 Arial。调用方需持有 g_pdfium_lock
+static FPDF_FONT substitute_font(replace_context_t* ctx, FPDF_DOCUMENT doc) {
+    font_cache_t* fonts = &ctx->fonts;
+    if (fonts->substitute || fonts->substitute_failed) return fonts->substitute;
+
+    const pdf_replace_options_t* options = ctx->options;
+    if (options && options->substitute_font_data && options->substitute_font_size > 0) {
+        fonts->substitute = FPDFText_LoadFont(doc, options->substitute_font_data,
+                                              (uint32_t)options->substitute_font_size,
+                                              FPDF_FONT_TRUETYPE, 1);
+    } else {
+        fonts->substitute = FPDFText_LoadStandardFont(doc, "Arial");
+    }
+    if (fonts->substitute) {
+        fonts->loads++;
+    } else {
+        debug_log("Failed to load substitute font");
+        fonts->substitute_failed = 1;
+    }
+    return fonts->substitute;
+}
+
+// 关闭字体缓存持有的字体句柄并释放覆盖缓存，文本对象各自持有字体的引用，不受影响
+static void font_cache_release(font_cache_t* fonts) {
+    if (fonts->substitute) FPDFFont_Close(fonts->substitute);
+    for (int i = 0; i < fonts->coverage_count; i++) {
+        free(fonts->coverage[i].bmp);
+    }
+    free(fonts->coverage);
+    memset(fonts, 0, sizeof(*fonts));
+}
+
+// 两个字形轮廓是否相同
+static int glyph_paths_equal(FPDF_GLYPHPATH a, FPDF_GLYPHPATH b) {
+    if (a == b) return 1;
+    if (!a || !b) return 0;
+    int count = FPDFGlyphPath_CountGlyphSegments(a);
+    if (count != FPDFGlyphPath_CountGlyphSegments(b)) return 0;
+    for (int i = 0; i < count; i++) {
+        FPDF_PATHSEGMENT sa = FPDFGlyphPath_GetGlyphPathSegment(a, i);
+        FPDF_PATHSEGMENT sb = FPDFGlyphPath_GetGlyphPathSegment(b, i);
+        float ax = 0, ay = 0, bx = 0, by = 0;
+        FPDFPathSegment_GetPoint(sa, &ax, &ay);
+        FPDFPathSegment_GetPoint(sb, &bx, &by);
+        if (ax != bx || ay != by || FPDFPathSegment_GetType(sa) != FPDFPathSegment_GetType(sb)) return 0;
+    }
+    return 1;
+}
+
+#define COVERAGE_GLYPH_SIZE 12.0f   // 覆盖检查时取字形使用的字号，只用于比较轮廓
+
+// 检查字体是否包含某个字符：
+// - 字形宽度为 0 表示字体的 Widths 中没有该字符（简单字体的子集常见）；
+// - 没有字形轮廓表示字体无法绘制该字符；
+// - 轮廓与字体中不可能存在的字符（U+FFFF）相同，说明画出的是 .notdef，
+//   CID 子集字体对缺失的字符仍会给出默认宽度，只能这样识别。
+static int font_has_code_point(FPDF_FONT font, uint32_t code_point) {
+    float width = 0;
+    if (!FPDFFont_GetGlyphWidth(font, code_point, COVERAGE_GLYPH_SIZE, &width) || width <= 0) return 0;
+    if (code_point == ' ') return 1;
+
+    FPDF_GLYPHPATH glyph = FPDFFont_GetGlyphPath(font, code_point, COVERAGE_GLYPH_SIZE);
+    if (!glyph) return 0;
+    FPDF_GLYPHPATH notdef = FPDFFont_GetGlyphPath(font, 0xFFFF, COVERAGE_GLYPH_SIZE);
+    return !notdef || !glyph_paths_equal(glyph, notdef);
+}
+
+// 查找字体的覆盖缓存，不存在时新建；内存不足时返回 NULL，调用方直接检查不缓存
+static font_coverage_t* font_coverage(font_cache_t* fonts, FPDF_FONT font) {
+    for (int i = 0; i < fonts->coverage_count; i++) {
+        if (fonts->coverage[i].font == font) return &fonts->coverage[i];
+    }
+    if (fonts->coverage_count == fonts->coverage_capacity) {
+        int capacity = fonts->coverage_capacity ? fonts->coverage_capacity * 2 : 8;
+        font_coverage_t* grown = (font_coverage_t*)realloc(fonts->coverage, capacity * sizeof(font_coverage_t));
+        if (!grown) return NULL;
+        fonts->coverage = grown;
+        fonts->coverage_capacity = capacity;
+    }
+    font_coverage_t* entry = &fonts->coverage[fonts->coverage_count++];
+    entry->font = font;
+    entry->bmp = (unsigned char*)calloc(0x10000, 1);
+    return entry;
+}
+
+// 字体是否包含文本中的全部字符，BMP 字符的结果按字体缓存
+static int font_covers_text(font_cache_t* fonts, FPDF_FONT font, const unsigned short* text) {
+    font_coverage_t* coverage = font_coverage(fonts, font);
+    for (const unsigned short* unit = text; *unit; unit++) {
+        uint32_t code_point = *unit;
+        if (code_point >= 0xD800 && code_point <= 0xDBFF && unit[1] >= 0xDC00 && unit[1] <= 0xDFFF) {
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (unit[1] - 0xDC00);
+            unit++;
+            if (!font_has_code_point(font, code_point)) return 0;
+            continue;
+        }
+
+        if (!coverage || !coverage->bmp) {
+            if (!font_has_code_point(font, code_point)) return 0;
+            continue;
+        }
+        if (coverage->bmp[code_point] == 0) {
+            coverage->bmp[code_point] = font_has_code_point(font, code_point) ? 1 : 2;
+        }
+        if (coverage->bmp[code_point] != 1) return 0;
+    }
+    return 1;
+}
+
+// 选择替换文本使用的字体：PDF_FONT_PRESERVE 模式下原字体覆盖全部字符时沿用原字体
+static FPDF_FONT replacement_font(replace_context_t* ctx, FPDF_DOCUMENT doc, FPDF_PAGEOBJECT obj,
+                                  const unsigned short* text) {
+    if (ctx->font_mode == PDF_FONT_PRESERVE) {
+        FPDF_FONT original = FPDFTextObj_GetFont(obj);
+        if (original && font_covers_text(&ctx->fonts, original, text)) return original;
+    }
+    return substitute_font(ctx, doc);
+}
+
+// replace_text_object 的结果
+typedef enum {
+    TEXT_REPLACE_FAILED = 0,    // 失败，页面保持原样
+    TEXT_REPLACE_DETACHED = 1,  // 原对象已从页面移除，由调用方销毁
+    TEXT_REPLACE_IN_PLACE = 2   // 原对象的文本已就地修改，仍留在页面上
+} text_replace_result_t;
+
+// 替换页面上文本对象的文本。原字体能显示替换文本时直接在原对象上调用 FPDFText_SetText，
+// 对象的变换矩阵、裁剪路径和在对象列表中的位置（绘制顺序）都保持不变；
+// 否则用字体缓存中的替代字体创建新对象追加到页面末尾，原对象从页面移除后由调用方销毁：
+// 文本页按句柄引用对象，需在关闭文本页之后再销毁。
+static text_replace_result_t replace_text_object(
+    replace_context_t* ctx,
+    FPDF_DOCUMENT doc,
+    FPDF_PAGE page,
+    FPDF_PAGEOBJECT obj,
+    const unsigned short* replacement_utf16
+) {
+    FPDF_FONT font = replacement_font(ctx, doc, obj, replacement_utf16);
+    if (!font) return TEXT_REPLACE_FAILED;
+    if (font == FPDFTextObj_GetFont(obj)) {
+        // 只统计实际就地写入成功的替换
+        if (!FPDFText_SetText(obj, replacement_utf16)) return TEXT_REPLACE_FAILED;
+        ctx->fonts.preserved++;
+        return TEXT_REPLACE_IN_PLACE;
+    }
+
+    // 获取对象的位置和属性
+    float left = 0, top = 0, right = 0, bottom = 0;
+    FPDFPageObj_GetBounds(obj, &left, &bottom, &right, &top);
+
+    // 获取字体大小和颜色
+    float font_size = 0;
+    if (!FPDFTextObj_GetFontSize(obj, &font_size)) {
+        font_size = 12.0f;  // 默认字体大小
+    }
+
+    unsigned int R = 0, G = 0, B = 0, A = 255;
+    int has_color = FPDFPageObj_GetFillColor(obj, &R, &G, &B, &A);
+
+    // 创建新的文本对象
+    FPDF_PAGEOBJECT new_obj = FPDFPageObj_CreateTextObj(doc, font, font_size);
+    if (!new_obj) return TEXT_REPLACE_FAILED;
+
+    // 设置文本内容
+    if (!FPDFText_SetText(new_obj, replacement_utf16)) {
+        FPDFPageObj_Destroy(new_obj);
+        return TEXT_REPLACE_FAILED;
+    }
+
+    // 新对象就绪后再删除原始对象，失败时页面保持原样
+    if (!FPDFPage_RemoveObject(page, obj)) {
+        FPDFPageObj_Destroy(new_obj);
+        return TEXT_REPLACE_FAILED;
+    }
+
+    // 计算垂直中心点，使用它作为基准点
+    // float baseline = bottom + (top - bottom) * 0.025f;  // 降低基线位置
+    FPDFPageObj_Transform(new_obj, 1.0, 0, 0, 1.0, left, bottom);
+
+    // 设置颜色
+    if (has_color) {
+        FPDFPageObj_SetFillColor(new_obj, R, G, B, A);
+    }
+
+    // 添加到页面
+    FPDFPage_InsertObject(page, new_obj);
+    return TEXT_REPLACE_DETACHED;
+}
+
+// 对文本对象的操作
+typedef enum {
+    TEXT_EDIT_REPLACE = 0,  // 用新文本替换整个对象
+    TEXT_EDIT_REMOVE = 1    // 删除对象（重写后对象中已没有剩余文本）
+} text_edit_action_t;
+
+// 单个文本对象的待执行替换
+typedef struct {
+    int object_index;           // 页面对象编号
+    int pair;                   // 命中的替换组编号，-1 表示命中数由页面匹配统计
+    text_edit_action_t action;  // 对该对象的操作
+    unsigned short* text;       // 重写后的文本（以 0 结尾），NULL 表示使用替换组的文本
+    int text_len;
+    int text_capacity;
+} text_edit_t;
+
+// 一次匹配：文本页模式下字符编号为文本页中的编号，逐对象模式下为对象文本中的代码单元编号
+typedef struct {
+    int start;  // 起始字符编号
+    int count;  // 字符数
+    int pair;   // 替换组编号
+    int edit;   // 承载替换文本的操作编号，-1 表示尚未分配
+} page_match_t;
+
+// 一页的扫描结果，所有数组和重写文本都分配在暂存区中，随本页的回退一并回收
+typedef struct {
+    scratch_arena_t* arena;     // 分配所在的暂存区
+    text_edit_t* edits;         // 待执行的替换，按对象编号递增
+    int edit_count;
+    int edit_capacity;
+    page_match_t* matches;      // 选中的匹配，用于统计命中数
+    int match_count;
+    int match_capacity;
+} page_edits_t;
+
+static int page_edits_append(page_edits_t* page, int object_index, int pair,
+                             text_edit_action_t action) {
+    if (page->edit_count == page->edit_capacity) {
+        int capacity = page->edit_capacity ? page->edit_capacity * 2 : 8;
+        text_edit_t* edits = (text_edit_t*)arena_grow(page->arena, page->edits,
+                                                      page->edit_capacity * sizeof(text_edit_t),
+                                                      capacity * sizeof(text_edit_t));
+        if (!edits) return 0;
+        page->edits = edits;
+        page->edit_capacity = capacity;
+    }
+    text_edit_t* edit = &page->edits[page->edit_count];
+    memset(edit, 0, sizeof(*edit));
+    edit->object_index = object_index;
+    edit->pair = pair;
+    edit->action = action;
+    page->edit_count++;
+    return 1;
+}
+
+// 清空扫描结果，开始新的一页。之前的数组不释放，由调用方回退暂存区时回收
+static void page_edits_reset(page_edits_t* page, scratch_arena_t* arena) {
+    memset(page, 0, sizeof(*page));
+    page->arena = arena;
+}
+
+// 向重写文本末尾追加 UTF-16 代码单元，始终保留结尾的 0
+static int text_edit_append(scratch_arena_t* arena, text_edit_t* edit, const unsigned short* units, int count) {
+    if (edit->text_len + count + 1 > edit->text_capacity) {
+        int capacity = edit->text_capacity ? edit->text_capacity : 32;
+        while (capacity < edit->text_len + count + 1) capacity *= 2;
+        unsigned short* text = (unsigned short*)arena_grow(arena, edit->text,
+                                                           edit->text_capacity * sizeof(unsigned short),
+                                                           capacity * sizeof(unsigned short));
+        if (!text) return 0;
+        edit->text = text;
+        edit->text_capacity = capacity;
+    }
+    memcpy(edit->text + edit->text_len, units, count * sizeof(unsigned short));
+    edit->text_len += count;
+    edit->text[edit->text_len] = 0;
+    return 1;
+}
+
+static int page_match_append(page_edits_t* page, int start, int count, int pair, int edit) {
+    if (page->match_count == page->match_capacity) {
+        int capacity = page->match_capacity ? page->match_capacity * 2 : 16;
+        page_match_t* matches = (page_match_t*)arena_grow(page->arena, page->matches,
+                                                          page->match_capacity * sizeof(page_match_t),
+                                                          capacity * sizeof(page_match_t));
+        if (!matches) return 0;
+        page->matches = matches;
+        page->match_capacity = capacity;
+    }
+    page_match_t* match = &page->matches[page->match_count++];
+    match->start = start;
+    match->count = count;
+    match->pair = pair;
+    match->edit = edit;
+    return 1;
+}
+
+// 在一个文本对象的文本中查找所有目标文本，命中时为该对象记录一个操作。
+// 每个匹配替换为对应组的替换文本，匹配之间和前后未被匹配的文本保持不变；
+// 匹配器从上一个匹配的结尾继续查找，不会从头重新扫描。
+// 整个对象恰好是一个目标时直接使用替换组的文本，不生成重写文本。成功返回 1，内存不足返回 0
+static int collect_text_edits(replace_context_t* ctx, int object_index,
+                              const unsigned short* text, unsigned long len, page_edits_t* edits) {
+    if (len == 0) return 1;
+    const pattern_matcher_t* matcher = ctx->matcher;
+    size_t start = 0;
+    int pair = matcher_find(matcher, text, len, 0, &start);
+    if (pair < 0) return 1;
+
+    size_t end = start + matcher->pattern_lengths[pair];
+    if (start == 0 && end == len) {
+        // 替换文本为空时直接删除对象，仍按替换组统计命中
+        text_edit_action_t action = ctx->replacements_utf16[pair][0] ? TEXT_EDIT_REPLACE : TEXT_EDIT_REMOVE;
+        return page_edits_append(edits, object_index, pair, action);
+    }
+
+    if (!page_edits_append(edits, object_index, -1, TEXT_EDIT_REPLACE)) return 0;
+    int edit_index = edits->edit_count - 1;
+    text_edit_t* edit = &edits->edits[edit_index];
+    size_t from = 0;
+    while (pair >= 0) {
+        // 只搜索时不生成重写文本，只记录命中位置
+        if (!ctx->search) {
+            const unsigned short* replacement = ctx->replacements_utf16[pair];
+            int replacement_len = 0;
+            while (replacement[replacement_len]) replacement_len++;
+            if (!text_edit_append(edits->arena, edit, text + from, (int)(start - from)) ||
+                !text_edit_append(edits->arena, edit, replacement, replacement_len)) {
+                return 0;
+            }
+        }
+        if (!page_match_append(edits, (int)start, (int)(end - start), pair, edit_index)) return 0;
+        from = end;
+        pair = matcher_find(matcher, text, len, from, &start);
+        if (pair >= 0) end = start + matcher->pattern_lengths[pair];
+    }
+    if (ctx->search) return 1;
+    if (!text_edit_append(edits->arena, edit, text + from, (int)(len - from))) return 0;
+
+    // 重写后为空的对象直接删除
+    if (edit->text_len == 0) edit->action = TEXT_EDIT_REMOVE;
+    return 1;
+}
+
+// 页面对象句柄到对象编号的映射项
+typedef struct {
+    FPDF_PAGEOBJECT object;
+    int index;
+} object_lookup_t;
+
+static int compare_page_matches(const void* a, const void* b) {
+    const page_match_t* x = (const page_match_t*)a;
+    const page_match_t* y = (const page_match_t*)b;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    if (x->count != y->count) return x->count > y->count ? -1 : 1;
+    return x->pair - y->pair;
+}
+
+static int compare_object_lookup(const void* a, const void* b) {
+    const object_lookup_t* x = (const object_lookup_t*)a;
+    const object_lookup_t* y = (const object_lookup_t*)b;
+    if (x->object == y->object) return 0;
+    return (uintptr_t)x->object < (uintptr_t)y->object ? -1 : 1;
+}
+
+static int lookup_object_index(const object_lookup_t* lookup, int count, FPDF_PAGEOBJECT object) {
+    object_lookup_t key = { object, -1 };
+    const object_lookup_t* found = (const object_lookup_t*)bsearch(
+        &key, lookup, count, sizeof(object_lookup_t), compare_object_lookup);
+    return found ? found->index : -1;
+}
+
+// 按文本页的字符顺序重写被匹配触及的文本对象：匹配到的字符被删除，
+// 替换文本写入匹配中第一个字符所在的对象，对象中未被匹配的前后文本保持不变。
+// matches 已按起始位置排序且互不重叠，成功返回 1，内存不足返回 0。
+static int rewrite_matched_objects(replace_context_t* ctx, FPDF_TEXTPAGE text_page,
+                                   const int* char_object, int char_count,
+                                   const int* object_edit, page_edits_t* edits) {
+    page_match_t* matches = edits->matches;
+    int m = 0;
+    for (int c = 0; c < char_count; c++) {
+        while (m < edits->match_count && c >= matches[m].start + matches[m].count) m++;
+        int index = char_object[c];
+        text_edit_t* edit = index >= 0 && object_edit[index] >= 0 ? &edits->edits[object_edit[index]] : NULL;
+
+        if (m < edits->match_count && c >= matches[m].start) {
+            // 匹配内的字符：只在第一个属于对象的字符处写入替换文本
+            if (edit && matches[m].edit < 0) {
+                const unsigned short* replacement = ctx->replacements_utf16[matches[m].pair];
+                int len = 0;
+                while (replacement[len]) len++;
+                if (!text_edit_append(edits->arena, edit, replacement, len)) return 0;
+                matches[m].edit = object_edit[index];
+            }
+            continue;
+        }
+        if (!edit) continue;
+
+        // 保留对象中未被匹配的字符，生成的换行不属于对象的原始文本
+        unsigned int unicode = FPDFText_GetUnicode(text_page, c);
+        if (unicode == '\r' || unicode == '\n' || unicode == 0) continue;
+        unsigned short units[2];
+        int unit_count = 1;
+        if (unicode > 0xFFFF) {
+            unicode -= 0x10000;
+            units[0] = (unsigned short)(0xD800 | (unicode >> 10));
+            units[1] = (unsigned short)(0xDC00 | (unicode & 0x3FF));
+            unit_count = 2;
+        } else {
+            units[0] = (unsigned short)unicode;
+        }
+        if (!text_edit_append(edits->arena, edit, units, unit_count)) return 0;
+    }
+
+    // 重写后为空的对象直接删除
+    for (int i = 0; i < edits->edit_count; i++) {
+        if (edits->edits[i].text_len == 0) edits->edits[i].action = TEXT_EDIT_REMOVE;
+    }
+    return 1;
+}
+
+// 用文本页搜索索引检查页面上是否有任一目标文本，不枚举页面对象
+static int text_page_has_target(replace_context_t* ctx, FPDF_TEXTPAGE text_page) {
+    int found = 0;
+    for (size_t pair = 0; pair < ctx->replacement_count && !found; pair++) {
+        FPDF_SCHHANDLE search = FPDFText_FindStart(text_page, ctx->targets_utf16[pair], FPDF_MATCHCASE, 0);
+        if (!search) continue;
+        found = FPDFText_FindNext(search);
+        FPDFText_FindClose(search);
+    }
+    return found;
+}
+
+// 用文本页的搜索索引查找一页上的所有目标文本，并把命中映射回页面对象。
+// 匹配可以跨越多个文本对象，只重写被匹配触及的对象。
+// 多个匹配重叠时取最靠左的（同一位置取最长的），调用方需持有 g_pdfium_lock。
+// 成功返回 1，内存不足返回 0。
+static int search_page_edits(replace_context_t* ctx, FPDF_PAGE page, FPDF_TEXTPAGE text_page,
+                             page_edits_t* edits) {
+    int ok = 1;
+
+    // 逐个目标文本在文本页上搜索
+    for (size_t pair = 0; pair < ctx->replacement_count && ok; pair++) {
+        FPDF_SCHHANDLE search = FPDFText_FindStart(text_page, ctx->targets_utf16[pair], FPDF_MATCHCASE, 0);
+        if (!search) continue;
+        while (ok && FPDFText_FindNext(search)) {
+            ok = page_match_append(edits, FPDFText_GetSchResultIndex(search), FPDFText_GetSchCount(search),
+                                   (int)pair, -1);
+        }
+        FPDFText_FindClose(search);
+    }
+    if (!ok || edits->match_count == 0) return ok;
+
+    // 只保留互不重叠的匹配
+    page_match_t* matches = edits->matches;
+    qsort(matches, edits->match_count, sizeof(page_match_t), compare_page_matches);
+    int selected = 0;
+    int covered_until = -1;
+    for (int m = 0; m < edits->match_count; m++) {
+        if (matches[m].start < covered_until) continue;
+        covered_until = matches[m].start + matches[m].count;
+        matches[selected++] = matches[m];
+    }
+    edits->match_count = selected;
+
+    // 建立对象句柄到编号的映射，以及每个字符所属的对象编号
+    int obj_count = FPDFPage_CountObjects(page);
+    int char_count = FPDFText_CountChars(text_page);
+    if (obj_count < 0) obj_count = 0;
+    if (char_count < 0) char_count = 0;
+    object_lookup_t* lookup = (object_lookup_t*)arena_alloc(&ctx->arena, obj_count * sizeof(object_lookup_t));
+    int* object_edit = (int*)arena_alloc(&ctx->arena, obj_count * sizeof(int));
+    int* char_object = (int*)arena_alloc(&ctx->arena, char_count * sizeof(int));
+    if (!lookup || !object_edit || !char_object) return 0;
+    for (int i = 0; i < obj_count; i++) {
+        lookup[i].object = FPDFPage_GetObject(page, i);
+        lookup[i].index = i;
+        object_edit[i] = -1;
+    }
+    qsort(lookup, obj_count, sizeof(object_lookup_t), compare_object_lookup);
+    for (int c = 0; c < char_count; c++) {
+        // 生成的空格、换行等字符可能不属于任何对象
+        FPDF_PAGEOBJECT object = FPDFText_GetTextObject(text_page, c);
+        char_object[c] = object ? lookup_object_index(lookup, obj_count, object) : -1;
+    }
+
+    // 标记被匹配触及的对象，并按对象编号顺序为它们分配操作
+    for (int m = 0; m < selected; m++) {
+        for (int c = matches[m].start; c < matches[m].start + matches[m].count && c < char_count; c++) {
+            if (char_object[c] >= 0) object_edit[char_object[c]] = 0;
+        }
+    }
+    for (int i = 0; i < obj_count && ok; i++) {
+        if (object_edit[i] < 0) continue;
+        object_edit[i] = edits->edit_count;
+        ok = page_edits_append(edits, i, -1, TEXT_EDIT_REPLACE);
+    }
+
+    if (ok && ctx->search) {
+        // 只搜索时不生成重写文本，只把每个匹配关联到其第一个字符所在的对象
+        for (int m = 0; m < selected; m++) {
+            for (int c = matches[m].start; c < matches[m].start + matches[m].count && c < char_count; c++) {
+                if (char_object[c] < 0) continue;
+                matches[m].edit = object_edit[char_object[c]];
+                break;
+            }
+        }
+    } else if (ok) {
+        ok = rewrite_matched_objects(ctx, text_page, char_object, char_count, object_edit, edits);
+    }
+    return ok;
+}
+
+// 逐个读取页面上的文本对象并匹配，把命中的对象按编号顺序记录到 edits，不改动页面。
+// 调用方需持有 g_pdfium_lock，成功返回 1，内存不足返回 0
+static int collect_object_edits(replace_context_t* ctx, FPDF_PAGE page, FPDF_TEXTPAGE text_page,
+                                text_scratch_t* scratch, page_edits_t* edits) {
+    int obj_count = FPDFPage_CountObjects(page);
+    for (int obj_index = 0; obj_index < obj_count; obj_index++) {
+        FPDF_PAGEOBJECT obj = FPDFPage_GetObject(page, obj_index);
+        if (!obj || FPDFPageObj_GetType(obj) != FPDF_PAGEOBJ_TEXT) continue;
+
+        ctx->stats.objects_scanned++;
+        long len = read_text_object(obj, text_page, &ctx->arena, scratch);
+        if (len < 0 || !collect_text_edits(ctx, obj_index, scratch->data, (unsigned long)len, edits)) return 0;
+    }
+    return 1;
+}
+
+// 重新生成被改动页面的内容流；没有改动的页面保留原内容流，不会被重写
+static void regenerate_page(replace_context_t* ctx, FPDF_PAGE page) {
+    double start = monotonic_ms();
+    if (FPDFPage_GenerateContent(page)) {
+        ctx->pages_rewritten++;
+    }
+    ctx->stats.generate_ms += monotonic_ms() - start;
+}
+
+// 在已加载的页面上执行扫描得到的操作，调用方需持有 g_pdfium_lock，返回命中数。
+// modified 返回页面上是否有对象被改动（没有命中时也可能删除了对象）
+static int apply_edits_to_page(replace_context_t* ctx, FPDF_DOCUMENT doc, FPDF_PAGE page,
+                               const page_edits_t* edits, int* modified) {
+    *modified = 0;
+    if (edits->edit_count == 0) return 0;
+
+    // 先按扫描时的编号取出所有待操作对象的句柄，之后的删除和插入不会影响查找；
+    // 句柄列表分配在暂存区中，本页结束时回退
+    arena_mark_t page_mark = arena_mark(&ctx->arena);
+    FPDF_PAGEOBJECT* objects = (FPDF_PAGEOBJECT*)arena_alloc(&ctx->arena, edits->edit_count * sizeof(FPDF_PAGEOBJECT));
+    if (!objects) return -1;
+    for (int i = 0; i < edits->edit_count; i++) {
+        objects[i] = FPDFPage_GetObject(page, edits->edits[i].object_index);
+    }
+
+    // detached 记录哪些对象已从页面移除、需要销毁；就地修改的对象仍属于页面
+    unsigned char* detached = (unsigned char*)arena_alloc(&ctx->arena, edits->edit_count);
+    if (!detached) {
+        arena_rewind(&ctx->arena, page_mark);
+        return -1;
+    }
+
+    int hits = 0;
+    for (int i = 0; i < edits->edit_count; i++) {
+        const text_edit_t* edit = &edits->edits[i];
+        detached[i] = 0;
+        if (!objects[i]) continue;
+        text_replace_result_t replaced;
+        if (edit->action == TEXT_EDIT_REMOVE) {
+            replaced = FPDFPage_RemoveObject(page, objects[i]) ? TEXT_REPLACE_DETACHED : TEXT_REPLACE_FAILED;
+        } else {
+            const unsigned short* text = edit->text ? edit->text : ctx->replacements_utf16[edit->pair];
+            replaced = replace_text_object(ctx, doc, page, objects[i], text);
+        }
+        if (replaced == TEXT_REPLACE_FAILED) {
+            objects[i] = NULL;
+            continue;
+        }
+        detached[i] = replaced == TEXT_REPLACE_DETACHED;
+        *modified = 1;
+        if (edit->pair >= 0) {
+            ctx->replacements[edit->pair].hits++;
+            hits++;
+        }
+    }
+
+    // 文本页模式：承载替换文本的对象改写成功才计入命中
+    for (int m = 0; m < edits->match_count; m++) {
+        const page_match_t* match = &edits->matches[m];
+        if (match->edit >= 0 && objects[match->edit]) {
+            ctx->replacements[match->pair].hits++;
+            hits++;
+        }
+    }
+
+    // 所有操作完成后再销毁被移除的对象
+    for (int i = 0; i < edits->edit_count; i++) {
+        if (detached[i]) FPDFPageObj_Destroy(objects[i]);
+    }
+    arena_rewind(&ctx->arena, page_mark);
+    return hits;
+}
+
+// 记录一处命中，边界框取自匹配开头所在的对象，成功返回 1，内存不足返回 0
+static int record_hit(replace_context_t* ctx, FPDF_PAGE page, int page_index, int object_index,
+                      int pair, int start, int count) {
+    search_hits_t* search = ctx->search;
+    if (search->count == search->capacity) {
+        size_t capacity = search->capacity ? search->capacity * 2 : 64;
+        pdf_search_hit_t* hits = (pdf_search_hit_t*)realloc(search->hits, capacity * sizeof(pdf_search_hit_t));
+        if (!hits) return 0;
+        search->hits = hits;
+        search->capacity = capacity;
+    }
+
+    pdf_search_hit_t* hit = &search->hits[search->count++];
+    memset(hit, 0, sizeof(*hit));
+    hit->page_index = page_index;
+    hit->object_index = object_index;
+    hit->target_index = pair;
+    hit->char_start = start;
+    hit->char_count = count;
+    FPDF_PAGEOBJECT obj = object_index >= 0 ? FPDFPage_GetObject(page, object_index) : NULL;
+    if (obj) {
+        FPDFPageObj_GetBounds(obj, &hit->left, &hit->bottom, &hit->right, &hit->top);
+    }
+    ctx->replacements[pair].hits++;
+    return 1;
+}
+
+// 只搜索：把扫描阶段收集到的操作记录为命中，不改动页面，调用方需持有 g_pdfium_lock。
+// 逐对象模式下按对象编号排列，文本页模式下按文本顺序排列。返回命中数，内存不足返回 -1
+static int record_page_hits(replace_context_t* ctx, FPDF_PAGE page, int page_index,
+                            const page_edits_t* edits) {
+    int hits = 0;
+    int m = 0;
+    // 逐对象模式的匹配按所属操作的顺序排列，与整对象命中合并输出
+    for (int i = 0; i < edits->edit_count && ctx->match_mode == PDF_MATCH_TEXT_OBJECTS; i++) {
+        const text_edit_t* edit = &edits->edits[i];
+        if (edit->pair >= 0) {
+            if (!record_hit(ctx, page, page_index, edit->object_index, edit->pair,
+                            0, (int)ctx->matcher->pattern_lengths[edit->pair])) return -1;
+            hits++;
+        }
+        for (; m < edits->match_count && edits->matches[m].edit == i; m++) {
+            const page_match_t* match = &edits->matches[m];
+            if (!record_hit(ctx, page, page_index, edit->object_index, match->pair,
+                            match->start, match->count)) return -1;
+            hits++;
+        }
+    }
+    for (; m < edits->match_count; m++) {
+        const page_match_t* match = &edits->matches[m];
+        int object_index = match->edit >= 0 ? edits->edits[match->edit].object_index : -1;
+        if (!record_hit(ctx, page, page_index, object_index, match->pair, match->start, match->count)) return -1;
+        hits++;
+    }
+    return hits;
+}
+
+// 逐页顺序扫描并替换，调用方需持有 g_pdfium_lock。
+// 每页分两个阶段：扫描阶段只读取和匹配，把待执行的操作收集到 edits；
+// 关闭文本页后应用阶段再一次执行所有删除和插入，遍历过程中页面对象的编号不会变化。
+// 返回 1 表示有文本被替换，0 表示未命中，-1 表示失败
+static int replace_pages_sequential(replace_context_t* ctx, FPDF_DOCUMENT doc, int page_count) {
+    int text_replaced = 0;
+    page_edits_t edits;                    // 所有页面共用，逐页清空
+
+    // 读取缓冲区的初始容量在所有页面之前分配；页内扩容得到的缓冲区随本页的回退回收，
+    // 下一页重新从初始缓冲区开始
+    text_scratch_t initial_scratch;
+    initial_scratch.capacity = TEXT_SCRATCH_UNITS;
+    initial_scratch.data = (unsigned short*)arena_alloc(&ctx->arena, TEXT_SCRATCH_UNITS * sizeof(unsigned short));
+    if (!initial_scratch.data) {
+        set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to allocate text buffer");
+        return -1;
+    }
+
+    for (int i = 0; i < page_count && text_replaced >= 0; i++) {
+        pdf_page_diagnostic_t* diagnostic = page_diagnostic(ctx, i);
+
+        FPDF_PAGE page = load_page(&ctx->stats, doc, i);
+        if (!page) {
+            debug_log("Failed to load page %d", i);
+            if (diagnostic) diagnostic->status = PDF_PAGE_LOAD_FAILED;
+            continue;
+        }
+
+        FPDF_TEXTPAGE text_page = load_text_page(&ctx->stats, page);
+        if (!text_page) {
+            if (diagnostic) diagnostic->status = PDF_PAGE_TEXT_LOAD_FAILED;
+            FPDF_ClosePage(page);
+            continue;
+        }
+
+        // 扫描阶段；预筛选：文本页上找不到任何目标文本的页面不再枚举对象
+        double start = monotonic_ms();
+        arena_mark_t page_mark = arena_mark(&ctx->arena);
+        text_scratch_t scratch = initial_scratch;
+        page_edits_reset(&edits, &ctx->arena);
+        int ok = 1;
+        if (ctx->page_prefilter && !text_page_has_target(ctx, text_page)) {
+            ctx->pages_skipped++;
+        } else if (ctx->match_mode == PDF_MATCH_TEXT_PAGE) {
+            ok = search_page_edits(ctx, page, text_page, &edits);
+        } else {
+            ok = collect_object_edits(ctx, page, text_page, &scratch, &edits);
+        }
+        FPDFText_ClosePage(text_page);
+        ctx->stats.scan_ms += monotonic_ms() - start;
+
+        // 应用阶段：只有改动过的页面才重新生成内容流；只搜索时只记录命中
+        start = monotonic_ms();
+        int page_modified = 0;
+        int hits = !ok ? -1 :
+                   ctx->search ? record_page_hits(ctx, page, i, &edits) :
+                   apply_edits_to_page(ctx, doc, page, &edits, &page_modified);
+        ctx->stats.apply_ms += monotonic_ms() - start;
+        if (page_modified) {
+            regenerate_page(ctx, page);
+        }
+        FPDF_ClosePage(page);
+        arena_rewind(&ctx->arena, page_mark);
+
+        if (hits < 0) {
+            set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to collect page edits");
+            text_replaced = -1;
+        } else if (hits > 0) {
+            text_replaced = 1;
+            if (diagnostic) diagnostic->hits += hits;
+        }
+    }
+
+    return text_replaced;
+}
+
+// 报告文档级的统计，释放字体缓存并关闭文档，调用方需持有 g_pdfium_lock
+static void close_document_locked(replace_context_t* ctx, FPDF_DOCUMENT doc) {
+    if (ctx->result) {
+        ctx->result->pages_rewritten = ctx->pages_rewritten;
+        ctx->result->passthrough = ctx->passthrough;
+        ctx->result->pages_skipped = ctx->pages_skipped;
+        ctx->result->font_loads = ctx->fonts.loads;
+        ctx->result->fonts_preserved = ctx->fonts.preserved;
+    }
+    font_cache_release(&ctx->fonts);
+    FPDF_CloseDocument(doc);
+}
+
+#define PASSTHROUGH_CHUNK_SIZE (256 * 1024)  // 直通复制时每次读取的字节数
+
+// 把 reader 的全部内容分块写入 writer（未命中直通时使用）
+static int copy_reader_to_writer(replace_context_t* ctx, FPDF_FILEWRITE* writer) {
+    unsigned char* chunk = (unsigned char*)malloc(PASSTHROUGH_CHUNK_SIZE);
+    if (!chunk) return 0;
+
+    int ok = 1;
+    for (size_t position = 0; position < ctx->reader->size && ok; position += PASSTHROUGH_CHUNK_SIZE) {
+        size_t size = ctx->reader->size - position;
+        if (size > PASSTHROUGH_CHUNK_SIZE) size = PASSTHROUGH_CHUNK_SIZE;
+        ok = read_input(ctx, NULL, position, chunk, size) &&
+             writer->WriteBlock(writer, chunk, (unsigned long)size);
+    }
+    free(chunk);
+    return ok;
+}
+
+// 保存文档到 writer 并关闭文档，调用方需持有 g_pdfium_lock
+static int save_document_locked(replace_context_t* ctx, FPDF_DOCUMENT doc, int text_replaced,
+                                FPDF_FILEWRITE* writer) {
+    if (!text_replaced && ctx->options && ctx->options->passthrough_on_miss) {
+        // 完整扫描后没有命中：不保存，由调用方直接输出原始输入；输入来自 reader 时在这里原样复制到 writer。
+        // 不用文本页搜索做预扫描，它可能漏掉逐对象匹配能找到的目标（见 page_prefilter）
+        ctx->passthrough = 1;
+        double start = monotonic_ms();
+        int ok = !ctx->reader || copy_reader_to_writer(ctx, writer);
+        ctx->stats.save_ms += monotonic_ms() - start;
+        if (!ok) set_context_error(ctx, PDF_ERROR_SAVE_FAILED, "Failed to copy unmodified PDF");
+        close_document_locked(ctx, doc);
+        return ok;
+    }
+    if (!text_replaced) {
+        set_context_error(ctx, PDF_ERROR_NO_TEXT_FOUND, "Target text not found in document");
+        close_document_locked(ctx, doc);
+        return 0;
+    }
+
+    // 增量更新时 PDFium 先原样写出输入的字节，再追加改动后的对象和新的交叉引用表
+    int incremental = ctx->options && ctx->options->save_mode == PDF_SAVE_INCREMENTAL;
+    double start = monotonic_ms();
+    int saved = FPDF_SaveAsCopy(doc, writer, incremental ? FPDF_INCREMENTAL : 0);
+    ctx->stats.save_ms += monotonic_ms() - start;
+    if (!saved) {
+        set_context_error(ctx, PDF_ERROR_SAVE_FAILED, "Failed to save modified PDF");
+        close_document_locked(ctx, doc);
+        return 0;
+    }
+
+    close_document_locked(ctx, doc);
+    return 1;
+}
+
+// 加载文档、执行替换并保存到 writer（只搜索时 writer 为 NULL），自行管理 g_pdfium_lock
+static int replace_text_with_pdfium(
+    replace_context_t* ctx,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    FPDF_FILEWRITE* writer
+) {
+    pthread_mutex_lock(&g_pdfium_lock);
+    int page_count = 0;
+    FPDF_DOCUMENT doc = load_document_locked(ctx, pdf_binary_stream, pdf_stream_size, &page_count);
+    if (!doc) {
+        pthread_mutex_unlock(&g_pdfium_lock);
+        return 0;
+    }
+
+    // 调用方提供的替代字体在替换前加载，字体数据无效时直接报错
+    const pdf_replace_options_t* options = ctx->options;
+    if (!ctx->search && options && options->substitute_font_data && !substitute_font(ctx, doc)) {
+        set_context_error(ctx, PDF_ERROR_LOAD_FAILED, "Failed to load substitute font");
+        close_document_locked(ctx, doc);
+        pthread_mutex_unlock(&g_pdfium_lock);
+        return 0;
+    }
+
+    int text_replaced = replace_pages_sequential(ctx, doc, page_count);
+    if (text_replaced < 0) {
+        close_document_locked(ctx, doc);
+        pthread_mutex_unlock(&g_pdfium_lock);
+        return 0;
+    }
+
+    // 只搜索时不保存
+    int ok = 1;
+    if (ctx->search) {
+        close_document_locked(ctx, doc);
+    } else {
+        ok = save_document_locked(ctx, doc, text_replaced, writer);
+    }
+    pthread_mutex_unlock(&g_pdfium_lock);
+    return ok;
+}
+
+// 替换文本的核心实现：验证参数后把结果写入 writer，调用方需保证 PDFium 库已初始化
+static int replace_text_in_document(
+    replace_context_t* ctx,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    FPDF_FILEWRITE* writer
+) {
+    double start = monotonic_ms();
+    debug_log("Starting replace_text_in_pdf_stream");
+    debug_log("Input parameters:");
+    debug_log("- pdf_stream_size: %zu", pdf_stream_size);
+    debug_log("- replacement_count: %zu", replacement_count);
+
+    // 参数验证
+    if (pdf_binary_stream == NULL && ctx->reader == NULL) {
+        set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "PDF binary stream is NULL");
+        return 0;
+    }
+    if (pdf_stream_size == 0) {
+        set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "PDF stream size is 0");
+        return 0;
+    }
+    if (replacements == NULL || replacement_count == 0) {
+        set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Replacement list is empty");
+        return 0;
+    }
+    for (size_t i = 0; i < replacement_count; i++) {
+        debug_log("- target_text[%zu]: %s", i, replacements[i].target_text ? replacements[i].target_text : "NULL");
+        debug_log("- replacement_text[%zu]: %s", i, replacements[i].replacement_text ? replacements[i].replacement_text : "NULL");
+        if (replacements[i].target_text == NULL) {
+            set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Target text is NULL");
+            return 0;
+        }
+        if (replacements[i].target_text[0] == '\0') {
+            set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Target text is empty");
+            return 0;
+        }
+        if (replacements[i].replacement_text == NULL) {
+            set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Replacement text is NULL");
+            return 0;
+        }
+        replacements[i].hits = 0;
+    }
+
+    // 验证 PDF 格式
+    unsigned char header[4];
+    if (pdf_stream_size < 4 || !read_input(ctx, pdf_binary_stream, 0, header, sizeof(header)) ||
+        header[0] != '%' || header[1] != 'P' || header[2] != 'D' || header[3] != 'F') {
+        set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Invalid PDF format");
+        return 0;
+    }
+
+    // 重置错误状态
+    set_context_error(ctx, PDF_SUCCESS, NULL);
+
+    // 构建匹配器并把替换文本转换为UTF-16LE（不涉及 PDFium，在锁外完成），
+    // 这些表和字符串都分配在本次调用的暂存区中
+    scratch_arena_t* arena = &ctx->arena;
+    unsigned short** replacements_utf16 = (unsigned short**)arena_alloc(arena, replacement_count * sizeof(unsigned short*));
+    unsigned short** targets_utf16 = (unsigned short**)arena_alloc(arena, replacement_count * sizeof(unsigned short*));
+    int ok = replacements_utf16 && targets_utf16;
+    if (!ok) {
+        set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to allocate replacement table");
+    }
+
+    for (size_t i = 0; i < replacement_count && ok; i++) {
+        int utf16_len = 0;
+        replacements_utf16[i] = utf8_to_utf16le(arena, replacements[i].replacement_text, &utf16_len);
+        targets_utf16[i] = utf8_to_utf16le(arena, replacements[i].target_text, &utf16_len);
+        if (!replacements_utf16[i] || !targets_utf16[i]) {
+            set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to convert replacement text to UTF-16");
+            ok = 0;
+        }
+    }
+
+    pattern_matcher_t matcher;
+    if (ok && !matcher_build(&matcher, (const unsigned short* const*)targets_utf16, replacement_count)) {
+        set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to build text matcher");
+        ok = 0;
+    }
+
+    if (ok) {
+        ctx->replacements = replacements;
+        ctx->replacement_count = replacement_count;
+        ctx->replacements_utf16 = replacements_utf16;
+        ctx->targets_utf16 = targets_utf16;
+        ctx->matcher = &matcher;
+        ctx->match_mode = ctx->options ? ctx->options->match_mode : PDF_MATCH_TEXT_OBJECTS;
+        ctx->font_mode = ctx->options ? ctx->options->font_mode : PDF_FONT_SUBSTITUTE;
+        ctx->page_prefilter = ctx->options && ctx->options->page_prefilter &&
+                              ctx->match_mode == PDF_MATCH_TEXT_OBJECTS;
+        ok = replace_text_with_pdfium(ctx, pdf_binary_stream, pdf_stream_size, writer);
+        ctx->matcher = NULL;
+        matcher_free(&matcher);
+    }
+
+    // 暂存区统一释放，并把申请次数和分阶段统计报告给调用方
+    if (ctx->result) {
+        ctx->result->scratch_allocations = arena->chunk_allocations;
+        ctx->result->scratch_bytes = arena->chunk_bytes;
+        ctx->stats.bytes_in = pdf_stream_size;
+        for (size_t i = 0; i < replacement_count; i++) {
+            ctx->stats.hits += replacements[i].hits;
+        }
+        ctx->stats.total_ms = monotonic_ms() - start;
+        ctx->result->stats = ctx->stats;
+    }
+    ctx->replacements_utf16 = NULL;
+    ctx->targets_utf16 = NULL;
+    arena_release(arena);
+    return ok;
+}
+
+// 初始化调用上下文并重置调用方的结果结构
+static void replace_context_init(replace_context_t* ctx, const pdf_replace_options_t* options,
+                                 pdf_result_t* result) {
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->options = options;
+    ctx->result = result;
+    if (result) {
+        memset(result, 0, sizeof(*result));
+    }
+}
+
+// 替换文本并把结果写入内存缓冲区
+static unsigned char* replace_text_to_memory(
+    replace_context_t* ctx,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    size_t* modified_pdf_size
+) {
+    if (modified_pdf_size == NULL) {
+        set_context_error(ctx, PDF_ERROR_INVALID_PARAMS, "Modified PDF size pointer is NULL");
+        return NULL;
+    }
+
+    memory_writer_t writer;
+    memory_writer_init(&writer, ctx->options, pdf_stream_size);
+    writer.base.WriteBlock = WriteBlockCallback;
+
+    int ok = replace_text_in_document(ctx, pdf_binary_stream, pdf_stream_size,
+                                      replacements, replacement_count, &writer.base);
+    if (ctx->result) {
+        ctx->result->stats.output_allocations = writer.allocations;
+    }
+    if (!ok) {
+        memory_writer_release(&writer);
+        return NULL;
+    }
+
+    // 未命中直通：返回输入缓冲区本身，不复制（输入来自 reader 时 writer 中已是原样复制的内容）
+    int borrowed = ctx->passthrough && !ctx->reader;
+    *modified_pdf_size = borrowed ? pdf_stream_size : writer.size;
+    if (ctx->result) {
+        ctx->result->stats.bytes_out = *modified_pdf_size;
+    }
+    if (borrowed) {
+        memory_writer_release(&writer);
+        return (unsigned char*)pdf_binary_stream;
+    }
+    return writer.data;
+}
+
+// 替换文本并把结果逐块交给流式写入器
+static pdf_error_code_t replace_text_to_stream(
+    replace_context_t* ctx,
+    stream_writer_t* writer,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    pdf_replacement_t* replacements,
+    size_t replacement_count
+) {
+    if (!stream_writer_init(writer, ctx->options)) {
+        set_context_error(ctx, PDF_ERROR_MEMORY_ERROR, "Failed to allocate write batch buffer");
+        return PDF_ERROR_MEMORY_ERROR;
+    }
+
+    int ok = replace_text_in_document(ctx, pdf_binary_stream, pdf_stream_size,
+                                      replacements, replacement_count, &writer->base);
+    // 未命中直通时原始输入直接交给写入器，不经过合并缓冲区
+    if (ok && !(ctx->passthrough && !ctx->reader ? stream_writer_flush(writer, pdf_binary_stream, pdf_stream_size)
+                                                 : stream_writer_flush(writer, NULL, 0))) {
+        set_context_error(ctx, PDF_ERROR_SAVE_FAILED, "Failed to write modified PDF");
+        ok = 0;
+    }
+    if (ctx->result) {
+        ctx->result->stats.bytes_out = writer->bytes_written;
+        ctx->result->stats.output_writes = writer->writes;
+    }
+    stream_writer_release(writer);
+
+    return ok ? PDF_SUCCESS : get_last_error();
+}
+
+unsigned char* pdf_engine_replace_text(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return NULL;
+    }
+
+    pdf_replacement_t replacement = { target_text, replacement_text, 0 };
+    return replace_text_to_memory(&ctx, pdf_binary_stream, pdf_stream_size,
+                                  &replacement, 1, modified_pdf_size);
+}
+
+unsigned char* pdf_engine_replace_batch(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return NULL;
+    }
+
+    return replace_text_to_memory(&ctx, pdf_binary_stream, pdf_stream_size,
+                                  replacements, replacement_count, modified_pdf_size);
+}
+
+pdf_error_code_t pdf_engine_replace_text_to_callback(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    pdf_write_callback_t write_callback,
+    void* user_data,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    if (write_callback == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "Write callback is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+
+    stream_writer_t writer;
+    writer.callback = write_callback;
+    writer.user_data = user_data;
+    writer.fd = -1;
+    pdf_replacement_t replacement = { target_text, replacement_text, 0 };
+    return replace_text_to_stream(&ctx, &writer, pdf_binary_stream, pdf_stream_size,
+                                  &replacement, 1);
+}
+
+pdf_error_code_t pdf_engine_replace_text_to_fd(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    int fd,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    if (fd < 0) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "Invalid file descriptor");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+
+    stream_writer_t writer;
+    writer.callback = NULL;
+    writer.user_data = NULL;
+    writer.fd = fd;
+    pdf_replacement_t replacement = { target_text, replacement_text, 0 };
+    return replace_text_to_stream(&ctx, &writer, pdf_binary_stream, pdf_stream_size,
+                                  &replacement, 1);
+}
+
+unsigned char* pdf_engine_replace_batch_from_reader(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const pdf_reader_t* reader,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    size_t* modified_pdf_size,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return NULL;
+    }
+    if (reader == NULL || reader->read == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF reader is NULL");
+        return NULL;
+    }
+
+    ctx.reader = reader;
+    return replace_text_to_memory(&ctx, NULL, reader->size,
+                                  replacements, replacement_count, modified_pdf_size);
+}
+
+pdf_error_code_t pdf_engine_replace_batch_from_reader_to_fd(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const pdf_reader_t* reader,
+    pdf_replacement_t* replacements,
+    size_t replacement_count,
+    int fd,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    if (reader == NULL || reader->read == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF reader is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    if (fd < 0) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "Invalid file descriptor");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+
+    ctx.reader = reader;
+    stream_writer_t writer;
+    writer.callback = NULL;
+    writer.user_data = NULL;
+    writer.fd = fd;
+    return replace_text_to_stream(&ctx, &writer, NULL, reader->size,
+                                  replacements, replacement_count);
+}
+
+pdf_error_code_t pdf_engine_search(
+    pdf_engine_t* engine,
+    const pdf_replace_options_t* options,
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* const* targets,
+    size_t target_count,
+    pdf_search_hit_t** hits,
+    size_t* hit_count,
+    pdf_result_t* result
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, options, result);
+    if (engine == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "PDF engine is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    if (hits == NULL || hit_count == NULL) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "Hit output pointer is NULL");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+    *hits = NULL;
+    *hit_count = 0;
+    if (targets == NULL || target_count == 0) {
+        set_context_error(&ctx, PDF_ERROR_INVALID_PARAMS, "Target list is empty");
+        return PDF_ERROR_INVALID_PARAMS;
+    }
+
+    // 复用替换的扫描路径：每个目标作为一组替换，替换文本不会被使用
+    pdf_replacement_t* replacements = (pdf_replacement_t*)calloc(target_count, sizeof(pdf_replacement_t));
+    if (!replacements) {
+        set_context_error(&ctx, PDF_ERROR_MEMORY_ERROR, "Failed to allocate target table");
+        return PDF_ERROR_MEMORY_ERROR;
+    }
+    for (size_t i = 0; i < target_count; i++) {
+        replacements[i].target_text = targets[i];
+        replacements[i].replacement_text = targets[i];
+    }
+
+    search_hits_t search = { NULL, 0, 0 };
+    ctx.search = &search;
+    int ok = replace_text_in_document(&ctx, pdf_binary_stream, pdf_stream_size,
+                                      replacements, target_count, NULL);
+    free(replacements);
+    if (!ok) {
+        free(search.hits);
+        return get_last_error();
+    }
+
+    *hits = search.hits;
+    *hit_count = search.count;
+    return PDF_SUCCESS;
+}
+
+void pdf_search_hits_free(pdf_search_hit_t* hits) {
+    free(hits);
+}
+
+unsigned char* replace_text_in_pdf_stream(
+    const unsigned char* pdf_binary_stream,
+    size_t pdf_stream_size,
+    const char* target_text,
+    const char* replacement_text,
+    size_t* modified_pdf_size
+) {
+    replace_context_t ctx;
+    replace_context_init(&ctx, NULL, NULL);
 
+    // 一次性调用：如果已有引擎持有库，这里只增加引用计数，不会重复初始化
+    pdf_replacement_t replacement = { target_text, replacement_text, 0 };
+    acquire_library();
+    unsigned char* result = replace_text_to_memory(&ctx, pdf_binary_stream, pdf_stream_size,
+                                                   &replacement, 1, modified_pdf_size);
+    release_library();
     return result;
 }
@@ -0,0 +1,183 @@
+#include "utf_transcode.h"
+
+// x86-64 上 SSE2 是基线指令集；AVX2 按函数启用并在运行时检测
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define UTF_HAVE_SSE2 1
+#if defined(__GNUC__) || defined(__clang__)
+#define UTF_HAVE_AVX2 1
+#endif
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define UTF_HAVE_WASM_SIMD 1
+#endif
+
+#define REPLACEMENT_CHARACTER 0xFFFD
+
+// 标量解码 src[*pos] 起的 UTF-8 字节，直到位置不小于 stop（多字节序列可能越过 stop）；
+// stop_at_ascii 非 0 时遇到连续的 ASCII 字符即停止，用于 SIMD 内核只处理非 ASCII 的片段
+static size_t utf8_to_utf16_range(const unsigned char* src, size_t len, size_t* pos, size_t stop,
+                                  int stop_at_ascii, unsigned short* dst) {
+    size_t i = *pos;
+    size_t out = 0;
+    while (i < stop) {
+        unsigned int c = src[i];
+        if (c < 0x80) {
+            // 单个夹在非 ASCII 字符间的 ASCII 字符（如中日韩文本中的空格）不值得回到向量路径
+            if (stop_at_ascii && (i + 1 >= len || src[i + 1] < 0x80)) break;
+            dst[out++] = (unsigned short)c;
+            i++;
+            continue;
+        }
+
+        // 根据首字节确定序列长度和第二个字节的合法范围（排除过长编码、代理项和超出范围的码点）
+        unsigned int need, cp;
+        unsigned char lower = 0x80, upper = 0xBF;
+        if (c >= 0xC2 && c <= 0xDF) {
+            need = 1;
+            cp = c & 0x1F;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            need = 2;
+            cp = c & 0x0F;
+            if (c == 0xE0) lower = 0xA0;
+            if (c == 0xED) upper = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            need = 3;
+            cp = c & 0x07;
+            if (c == 0xF0) lower = 0x90;
+            if (c == 0xF4) upper = 0x8F;
+        } else {
+            dst[out++] = REPLACEMENT_CHARACTER;
+            i++;
+            continue;
+        }
+
+        // 逐个检查后续字节，非法时把已读的合法前缀替换为一个 U+FFFD
+        size_t j = i + 1;
+        unsigned int k;
+        for (k = 0; k < need; k++, j++) {
+            if (j >= len) break;
+            unsigned char b = src[j];
+            if (b < lower || b > upper) break;
+            cp = (cp << 6) | (b & 0x3F);
+            lower = 0x80;
+            upper = 0xBF;
+        }
+        i = j;
+        if (k < need) {
+            dst[out++] = REPLACEMENT_CHARACTER;
+        } else if (cp >= 0x10000) {
+            cp -= 0x10000;
+            dst[out++] = (unsigned short)(0xD800 | (cp >> 10));
+            dst[out++] = (unsigned short)(0xDC00 | (cp & 0x3FF));
+        } else {
+            dst[out++] = (unsigned short)cp;
+        }
+    }
+    *pos = i;
+    return out;
+}
+
+size_t utf8_to_utf16_scalar(const char* src, size_t len, unsigned short* dst) {
+    size_t pos = 0;
+    return utf8_to_utf16_range((const unsigned char*)src, len, &pos, len, 0, dst);
+}
+
+// 以下 SIMD 内核批量处理 ASCII：整块都是 ASCII 时直接扩展写出；否则先写出块首的
+// ASCII 前缀（整块写出，前缀之后的内容随后被覆盖），再用标量实现解码紧随其后的非 ASCII 片段，
+// 遇到下一个 ASCII 字符时回到向量路径。输出缓冲区按最坏情况分配，整块写出不会越界。
+
+#if defined(UTF_HAVE_AVX2)
+__attribute__((target("avx2")))
+static size_t utf8_to_utf16_avx2(const unsigned char* src, size_t len, unsigned short* dst) {
+    size_t i = 0, out = 0;
+    while (i + 32 <= len) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1));
+        _mm256_storeu_si256((__m256i*)(dst + out), lo);
+        _mm256_storeu_si256((__m256i*)(dst + out + 16), hi);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(v);
+        if (mask == 0) {
+            i += 32;
+            out += 32;
+            continue;
+        }
+
+        unsigned int prefix = (unsigned int)__builtin_ctz(mask);
+        i += prefix;
+        out += prefix;
+        _mm256_zeroupper();
+        out += utf8_to_utf16_range(src, len, &i, len, 1, dst + out);
+    }
+    _mm256_zeroupper();
+    return out + utf8_to_utf16_range(src, len, &i, len, 0, dst + out);
+}
+#endif
+
+#if defined(UTF_HAVE_SSE2)
+static size_t utf8_to_utf16_sse2(const unsigned char* src, size_t len, unsigned short* dst) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0, out = 0;
+    while (i + 16 <= len) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + out), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dst + out + 8), _mm_unpackhi_epi8(v, zero));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(v);
+        if (mask == 0) {
+            i += 16;
+            out += 16;
+            continue;
+        }
+
+        unsigned int prefix = (unsigned int)__builtin_ctz(mask);
+        i += prefix;
+        out += prefix;
+        out += utf8_to_utf16_range(src, len, &i, len, 1, dst + out);
+    }
+    return out + utf8_to_utf16_range(src, len, &i, len, 0, dst + out);
+}
+#endif
+
+#if defined(UTF_HAVE_WASM_SIMD)
+static size_t utf8_to_utf16_simd128(const unsigned char* src, size_t len, unsigned short* dst) {
+    size_t i = 0, out = 0;
+    while (i + 16 <= len) {
+        v128_t v = wasm_v128_load(src + i);
+        wasm_v128_store(dst + out, wasm_u16x8_extend_low_u8x16(v));
+        wasm_v128_store(dst + out + 8, wasm_u16x8_extend_high_u8x16(v));
+        unsigned int mask = (unsigned int)wasm_i8x16_bitmask(v);
+        if (mask == 0) {
+            i += 16;
+            out += 16;
+            continue;
+        }
+
+        unsigned int prefix = (unsigned int)__builtin_ctz(mask);
+        i += prefix;
+        out += prefix;
+        out += utf8_to_utf16_range(src, len, &i, len, 1, dst + out);
+    }
+    return out + utf8_to_utf16_range(src, len, &i, len, 0, dst + out);
+}
+#endif
+
+#if defined(UTF_HAVE_AVX2)
+// AVX2 在运行时检测，编译时不要求 -mavx2
+static int cpu_has_avx2(void) {
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+size_t utf8_to_utf16(const char* src, size_t len, unsigned short* dst) {
+#if defined(UTF_HAVE_AVX2)
+    if (cpu_has_avx2()) return utf8_to_utf16_avx2((const unsigned char*)src, len, dst);
+#endif
+#if defined(UTF_HAVE_SSE2)
+    return utf8_to_utf16_sse2((const unsigned char*)src, len, dst);
+#elif defined(UTF_HAVE_WASM_SIMD)
+    return utf8_to_utf16_simd128((const unsigned char*)src, len, dst);
+#else
+    return utf8_to_utf16_scalar(src, len, dst);
+#endif
+}
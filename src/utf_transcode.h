@@ -0,0 +1,29 @@
+#ifndef UTF_TRANSCODE_H
+#define UTF_TRANSCODE_H
+
+#include <stddef.h>
+
+// UTF-8 转 UTF-16 时输出缓冲区的最大代码单元数（不含结尾的 0）：
+// 每个字节最多产生 1 个代码单元，4 字节序列产生 2 个
+#define UTF16_MAX_UNITS_FOR_UTF8(len) (len)
+
+/**
+ * 将 UTF-8 转换为 UTF-16LE
+ *
+ * 4 字节序列转换为代理对；非法或截断的序列（过长编码、代理项、超出 U+10FFFF 等）
+ * 按最大合法前缀替换为一个 U+FFFD，不会丢弃字符。
+ * 纯 ASCII 的片段使用 SIMD 批量处理（x86 上 SSE2，CPU 支持时 AVX2；WebAssembly 上 SIMD128）。
+ *
+ * @param src  UTF-8 字节
+ * @param len  字节数
+ * @param dst  输出缓冲区，至少 UTF16_MAX_UNITS_FOR_UTF8(len) 个代码单元
+ * @return  写入的代码单元数（不写结尾的 0）
+ */
+size_t utf8_to_utf16(const char* src, size_t len, unsigned short* dst);
+
+/**
+ * 与 utf8_to_utf16 相同，但只使用逐字节的标量实现（用于对比测试和基准）
+ */
+size_t utf8_to_utf16_scalar(const char* src, size_t len, unsigned short* dst);
+
+#endif // UTF_TRANSCODE_H
@@ -1,8 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include "../include/pdf_handler.h"
+#include "../src/utf_transcode.h"
+
+#define CONCURRENT_THREADS 4
 
 // 辅助函数：读取文件内容
 static unsigned char* read_file(const char* filename, size_t* size) {
@@ -132,11 +140,1203 @@ void test_shorter_replacement() {
     printf("Shorter replacement test passed.\n");
 }
 
+// 测试用例：同一个引擎上多次替换
+void test_engine_reuse() {
+    const char* input_file = "tests/test.pdf";
+    size_t input_size;
+
+    unsigned char* input_data = read_file(input_file, &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    for (int i = 0; i < 3; i++) {
+        size_t modified_size;
+        unsigned char* result = pdf_engine_replace_text(
+            engine,
+            NULL,
+            input_data,
+            input_size,
+            "test",
+            "sample",
+            &modified_size,
+            NULL
+        );
+        assert(result != NULL);
+        assert(modified_size > 0);
+        free(result);
+    }
+
+    // 引擎存活期间一次性调用也应正常工作
+    size_t modified_size;
+    unsigned char* result = replace_text_in_pdf_stream(
+        input_data, input_size, "test", "sample", &modified_size);
+    assert(result != NULL);
+    free(result);
+
+    pdf_engine_destroy(engine);
+
+    // 引擎销毁后一次性调用仍然可用
+    result = replace_text_in_pdf_stream(
+        input_data, input_size, "test", "sample", &modified_size);
+    assert(result != NULL);
+    free(result);
+
+    free(input_data);
+    printf("Engine reuse test passed.\n");
+}
+
+// 测试用例：结果结构中的错误信息与逐页诊断
+void test_result_diagnostics() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_result_t info;
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_text(
+        engine, NULL, input_data, input_size, "test", "sample", &modified_size, &info);
+    assert(result != NULL);
+    assert(info.code == PDF_SUCCESS);
+    assert(info.page_count > 0 && info.pages != NULL);
+
+    int hits = 0;
+    for (int i = 0; i < info.page_count; i++) {
+        assert(info.pages[i].page_index == i);
+        assert(info.pages[i].status == PDF_PAGE_OK);
+        hits += info.pages[i].hits;
+    }
+    assert(hits > 0);
+    free(result);
+    pdf_result_free(&info);
+
+    result = pdf_engine_replace_text(
+        engine, NULL, input_data, input_size, "nonexistent", "x", &modified_size, &info);
+    assert(result == NULL);
+    assert(info.code == PDF_ERROR_NO_TEXT_FOUND);
+    assert(strlen(info.message) > 0);
+    pdf_result_free(&info);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Result diagnostics test passed.\n");
+}
+
+// 计数分配器：记录分配和释放次数
+typedef struct {
+    int allocations;
+    int frees;
+} counting_allocator_state_t;
+
+static void* counting_realloc(void* user_data, void* ptr, size_t size) {
+    counting_allocator_state_t* state = (counting_allocator_state_t*)user_data;
+    if (ptr == NULL) state->allocations++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void* user_data, void* ptr) {
+    counting_allocator_state_t* state = (counting_allocator_state_t*)user_data;
+    state->frees++;
+    free(ptr);
+}
+
+// 测试用例：自定义分配器与预分配输出缓冲区
+void test_output_allocation() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 自定义分配器：输出缓冲区由分配器分配，调用方用它释放
+    counting_allocator_state_t state = { 0, 0 };
+    pdf_allocator_t allocator = { counting_realloc, counting_free, &state };
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.allocator = &allocator;
+
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "test", "sample", &modified_size, NULL);
+    assert(result != NULL);
+    assert(state.allocations == 1);
+    assert(memcmp(result, "%PDF", 4) == 0);
+    allocator.free_fn(allocator.user_data, result);
+    assert(state.frees == 1);
+
+    // 足够大的预分配缓冲区：直接写入，不经过分配器
+    size_t buffer_size = modified_size * 2;
+    unsigned char* buffer = (unsigned char*)malloc(buffer_size);
+    assert(buffer != NULL);
+    options.output_buffer = buffer;
+    options.output_buffer_size = buffer_size;
+    size_t presized_size;
+    result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "test", "sample", &presized_size, NULL);
+    assert(result == buffer);
+    assert(presized_size == modified_size);
+    assert(state.allocations == 1);
+
+    // 过小的预分配缓冲区：转移到分配器分配的缓冲区
+    options.output_buffer_size = 16;
+    result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "test", "sample", &presized_size, NULL);
+    assert(result != NULL && result != buffer);
+    assert(presized_size == modified_size);
+    assert(memcmp(result, "%PDF", 4) == 0);
+    allocator.free_fn(allocator.user_data, result);
+
+    free(buffer);
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Output allocation test passed.\n");
+}
+
+// 测试用例：一次处理多组替换并统计每组命中次数
+void test_batch_replacement() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 单独替换 "T740" 时的命中数，作为批量结果的参照
+    pdf_result_t info;
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_text(
+        engine, NULL, input_data, input_size, "T740", "T741", &modified_size, &info);
+    assert(result != NULL);
+    size_t single_hits = 0;
+    for (int i = 0; i < info.page_count; i++) {
+        single_hits += info.pages[i].hits;
+    }
+    free(result);
+    pdf_result_free(&info);
+
+    pdf_replacement_t replacements[] = {
+        { "test", "sample", 0 },
+        { "T740", "T741", 0 },
+        { "nonexistent", "missing", 0 },
+    };
+    size_t count = sizeof(replacements) / sizeof(replacements[0]);
+    result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, replacements, count, &modified_size, &info);
+    assert(result != NULL);
+    assert(info.code == PDF_SUCCESS);
+    assert(replacements[0].hits > 0);
+    assert(replacements[1].hits == single_hits);
+    assert(replacements[2].hits == 0);
+    free(result);
+    pdf_result_free(&info);
+
+    // 所有组都没有命中
+    pdf_replacement_t missing[] = { { "nonexistent", "x", 0 }, { "also missing", "y", 0 } };
+    result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, missing, 2, &modified_size, &info);
+    assert(result == NULL);
+    assert(info.code == PDF_ERROR_NO_TEXT_FOUND);
+    pdf_result_free(&info);
+
+    // 空目标文本是无效参数
+    pdf_replacement_t empty[] = { { "", "x", 0 } };
+    result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, empty, 1, &modified_size, &info);
+    assert(result == NULL);
+    assert(info.code == PDF_ERROR_INVALID_PARAMS);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Batch replacement test passed.\n");
+}
+
+// 测试用例：替换后的命中数与只搜索一致。
+// "the" 命中相邻的文本对象，逐页处理不能因为删除对象而跳过后面的对象
+void test_adjacent_replacement() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    const char* targets[] = { "T740", "test", "the" };
+    pdf_search_hit_t* hits = NULL;
+    size_t hit_count = 0;
+    pdf_error_code_t code = pdf_engine_search(
+        engine, NULL, input_data, input_size, targets, 3, &hits, &hit_count, NULL);
+    assert(code == PDF_SUCCESS);
+    size_t expected[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < hit_count; i++) {
+        expected[hits[i].target_index]++;
+    }
+    pdf_search_hits_free(hits);
+
+    pdf_replacement_t replacements[] = { { "T740", "T741", 0 }, { "test", "sample", 0 }, { "the", "THE", 0 } };
+    pdf_result_t info;
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, replacements, 3, &modified_size, &info);
+    assert(result != NULL);
+    assert(info.code == PDF_SUCCESS);
+    for (int i = 0; i < 3; i++) {
+        assert(expected[i] > 0);
+        assert(replacements[i].hits == expected[i]);
+    }
+
+    size_t page_hits = 0;
+    for (int i = 0; i < info.page_count; i++) {
+        assert(info.pages[i].page_index == i);
+        assert(info.pages[i].status == PDF_PAGE_OK);
+        page_hits += info.pages[i].hits;
+    }
+    assert(page_hits == replacements[0].hits + replacements[1].hits + replacements[2].hits);
+    free(result);
+    pdf_result_free(&info);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Adjacent replacement test passed.\n");
+}
+
+// 测试用例：文本页搜索模式
+void test_text_page_search() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.match_mode = PDF_MATCH_TEXT_PAGE;
+
+    pdf_replacement_t replacements[] = { { "T740", "T741", 0 }, { "test", "sample", 0 } };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, replacements, 2, &modified_size, NULL);
+    assert(result != NULL);
+    assert(replacements[0].hits > 0);
+    assert(replacements[1].hits > 0);
+    assert(memcmp(result, "%PDF", 4) == 0);
+    free(result);
+
+    // 未命中时与逐对象模式一样报告错误
+    result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "nonexistent", "sample", &modified_size, NULL);
+    assert(result == NULL);
+    assert(get_last_error() == PDF_ERROR_NO_TEXT_FOUND);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Text page search test passed.\n");
+}
+
+// 测试用例：跨越多个文本对象的目标在文本页模式下被替换，且不再残留
+void test_cross_object_replacement() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 测试文件中有一处 "Shenzhen" 被拆成了两个文本对象
+    pdf_replacement_t per_object = { "Shenzhen", "Xiamen", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &per_object, 1, &modified_size, NULL);
+    assert(result != NULL);
+    free(result);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.match_mode = PDF_MATCH_TEXT_PAGE;
+
+    pdf_replacement_t cross_object = { "Shenzhen", "Xiamen", 0 };
+    result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &cross_object, 1, &modified_size, NULL);
+    assert(result != NULL);
+    assert(cross_object.hits > per_object.hits);
+
+    // 替换后的文档中只剩替换文本
+    size_t again_size;
+    unsigned char* again = pdf_engine_replace_text(
+        engine, &options, result, modified_size, "Shenzhen", "Xiamen", &again_size, NULL);
+    assert(again == NULL);
+    assert(get_last_error() == PDF_ERROR_NO_TEXT_FOUND);
+
+    pdf_replacement_t replaced = { "Xiamen", "Xiamen", 0 };
+    again = pdf_engine_replace_batch(
+        engine, &options, result, modified_size, &replaced, 1, &again_size, NULL);
+    assert(again != NULL);
+    assert(replaced.hits == cross_object.hits);
+    free(again);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Cross-object replacement test passed.\n");
+}
+
+// 统计文档中目标文本的逐对象命中数（用替换为自身的方式计数）
+static size_t count_object_hits(pdf_engine_t* engine, const unsigned char* data, size_t size,
+                                const char* target) {
+    pdf_replacement_t counter = { target, target, 0 };
+    size_t counted_size;
+    unsigned char* counted = pdf_engine_replace_batch(
+        engine, NULL, data, size, &counter, 1, &counted_size, NULL);
+    free(counted);
+    return counter.hits;
+}
+
+// 测试用例：逐对象模式只替换对象中的目标文本，保留前后文本，同一对象中的每处目标都被替换
+void test_substring_replacement() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    size_t input_t = count_object_hits(engine, input_data, input_size, "t");
+    size_t input_upper = count_object_hits(engine, input_data, input_size, "E");
+    assert(input_t > 0);
+
+    pdf_replacement_t lower = { "e", "E", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &lower, 1, &modified_size, NULL);
+    assert(result != NULL);
+    assert(lower.hits > 0);
+
+    // 每处 "e" 计一次命中；其他字符都保留在原对象中
+    assert(count_object_hits(engine, result, modified_size, "e") == 0);
+    assert(count_object_hits(engine, result, modified_size, "E") == input_upper + lower.hits);
+    assert(count_object_hits(engine, result, modified_size, "t") == input_t);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Substring replacement test passed.\n");
+}
+
+// 测试用例：替换文本为空时删除整个对象都是占位符的文本对象，两种匹配方式都计入命中
+void test_whole_object_removal() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 测试文件中有多个文本对象的全部文本就是 "T740"
+    size_t input_hits = count_object_hits(engine, input_data, input_size, "T740");
+    assert(input_hits > 0);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    const pdf_match_mode_t modes[] = { PDF_MATCH_TEXT_OBJECTS, PDF_MATCH_TEXT_PAGE };
+    for (int i = 0; i < 2; i++) {
+        options.match_mode = modes[i];
+        pdf_replacement_t removal = { "T740", "", 0 };
+        size_t modified_size;
+        unsigned char* result = pdf_engine_replace_batch(
+            engine, &options, input_data, input_size, &removal, 1, &modified_size, NULL);
+        assert(result != NULL);
+        assert(removal.hits > 0);
+        assert(modes[i] != PDF_MATCH_TEXT_OBJECTS || removal.hits == input_hits);
+        assert(count_object_hits(engine, result, modified_size, "T740") == 0);
+        free(result);
+    }
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Whole object removal test passed.\n");
+}
+
+// 测试用例：只搜索不保存，命中位置与替换结果一致
+void test_search_only() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    const char* targets[] = { "T740", "test" };
+    pdf_replacement_t replaced[] = { { "T740", "T741", 0 }, { "test", "sample", 0 } };
+    size_t modified_size;
+    unsigned char* modified = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, replaced, 2, &modified_size, NULL);
+    assert(modified != NULL);
+    free(modified);
+
+    pdf_search_hit_t* hits = NULL;
+    size_t hit_count = 0;
+    pdf_result_t info;
+    pdf_error_code_t code = pdf_engine_search(
+        engine, NULL, input_data, input_size, targets, 2, &hits, &hit_count, &info);
+    assert(code == PDF_SUCCESS);
+    assert(hit_count == replaced[0].hits + replaced[1].hits);
+    assert(info.pages_rewritten == 0);
+    for (size_t i = 0; i < hit_count; i++) {
+        const pdf_search_hit_t* hit = &hits[i];
+        assert(hit->page_index >= 0 && hit->page_index < info.page_count);
+        assert(i == 0 || hit->page_index >= hits[i - 1].page_index);
+        assert(hit->object_index >= 0);
+        assert(hit->target_index == 0 || hit->target_index == 1);
+        assert(hit->char_count == (int)strlen(targets[hit->target_index]));
+        assert(hit->right > hit->left && hit->top > hit->bottom);
+    }
+    pdf_result_free(&info);
+    pdf_search_hits_free(hits);
+
+    // 没有命中不是错误
+    const char* missing[] = { "ThisTextDoesNotExist" };
+    pdf_search_hit_t* none = NULL;
+    size_t none_count = 1;
+    code = pdf_engine_search(engine, NULL, input_data, input_size, missing, 1, &none, &none_count, NULL);
+    assert(code == PDF_SUCCESS);
+    assert(none == NULL && none_count == 0);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Search-only test passed.\n");
+}
+
+// 测试用例：超长文本对象不会被截断
+void test_long_text_object() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 先生成包含超长文本对象的文档，标记放在文本末尾
+    char long_text[4096];
+    memset(long_text, 'x', sizeof(long_text));
+    memcpy(long_text + sizeof(long_text) - 9, "TAILMARK", 9);
+
+    pdf_replacement_t first = { "T740", long_text, 0 };
+    size_t long_size;
+    unsigned char* long_pdf = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &first, 1, &long_size, NULL);
+    assert(long_pdf != NULL);
+    assert(first.hits > 0);
+
+    pdf_replacement_t tail = { "TAILMARK", "END", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, long_pdf, long_size, &tail, 1, &modified_size, NULL);
+    assert(result != NULL);
+    assert(tail.hits == first.hits);
+    free(result);
+
+    free(long_pdf);
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Long text object test passed.\n");
+}
+
+// 测试用例：首字符种类较多（不启用预筛选）时命中数与逐个目标替换一致
+void test_many_first_units() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replacement_t single[] = { { "test", "sample", 0 }, { "T740", "T741", 0 } };
+    for (int i = 0; i < 2; i++) {
+        size_t modified_size;
+        unsigned char* result = pdf_engine_replace_batch(
+            engine, NULL, input_data, input_size, &single[i], 1, &modified_size, NULL);
+        assert(result != NULL);
+        free(result);
+    }
+
+    pdf_replacement_t many[] = {
+        { "test", "sample", 0 }, { "T740", "T741", 0 },
+        { "aq1", "x", 0 }, { "bq2", "x", 0 }, { "cq3", "x", 0 }, { "dq4", "x", 0 },
+        { "eq5", "x", 0 }, { "fq6", "x", 0 }, { "gq7", "x", 0 }, { "hq8", "x", 0 },
+    };
+    size_t many_count = sizeof(many) / sizeof(many[0]);
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, many, many_count, &modified_size, NULL);
+    assert(result != NULL);
+    assert(many[0].hits == single[0].hits);
+    assert(many[1].hits == single[1].hits);
+    for (size_t i = 2; i < many_count; i++) {
+        assert(many[i].hits == 0);
+    }
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Many first units test passed.\n");
+}
+
+// 测试用例：替代字体每个文档只加载一次，保留原字体模式的命中数不变
+void test_font_cache() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_result_t info;
+    pdf_replacement_t substitute = { "test", "sample", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &substitute, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(substitute.hits > 0);
+    assert(info.font_loads == 1);
+    pdf_result_free(&info);
+    free(result);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.font_mode = PDF_FONT_PRESERVE;
+    pdf_replacement_t preserve = { "test", "sample", 0 };
+    result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &preserve, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(preserve.hits == substitute.hits);
+    assert(info.font_loads <= 1);
+    pdf_result_free(&info);
+
+    // 沿用原字体写入的文本可以再次被找到
+    pdf_replacement_t again = { "sample", "sample", 0 };
+    size_t again_size;
+    unsigned char* again_pdf = pdf_engine_replace_batch(
+        engine, NULL, result, modified_size, &again, 1, &again_size, NULL);
+    assert(again_pdf != NULL);
+    assert(again.hits >= preserve.hits);
+    free(again_pdf);
+    free(result);
+
+    // 无效的替代字体数据直接报错
+    static const unsigned char bogus_font[] = "not a font";
+    pdf_replace_options_init(&options);
+    options.substitute_font_data = bogus_font;
+    options.substitute_font_size = sizeof(bogus_font);
+    pdf_replacement_t bogus = { "test", "sample", 0 };
+    result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &bogus, 1, &modified_size, NULL);
+    assert(result == NULL);
+    assert(get_last_error() == PDF_ERROR_LOAD_FAILED);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Font cache test passed.\n");
+}
+
+// 测试用例：原字体包含替换文本时就地修改原对象，缺少字符时改用替代字体
+void test_font_preservation() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.font_mode = PDF_FONT_PRESERVE;
+
+    pdf_result_t info;
+    pdf_replacement_t covered = { "T740", "T741", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &covered, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(covered.hits > 0);
+    assert(info.fonts_preserved == covered.hits);
+    assert(info.font_loads == 0);
+    pdf_result_free(&info);
+
+    // 沿用原字体时原对象被就地修改，输出中能按新文本再次找到这些对象
+    pdf_replacement_t reverted = { "T741", "T740", 0 };
+    size_t reverted_size;
+    unsigned char* reverted_result = pdf_engine_replace_batch(
+        engine, &options, result, modified_size, &reverted, 1, &reverted_size, NULL);
+    assert(reverted_result != NULL);
+    assert(reverted.hits == covered.hits);
+    free(reverted_result);
+    free(result);
+
+    // 原文档的子集字体中没有这些汉字
+    pdf_replacement_t missing = { "T740", "\xE6\xB7\xB1\xE5\x9C\xB3", 0 };
+    result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &missing, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(missing.hits == covered.hits);
+    assert(info.fonts_preserved == 0);
+    assert(info.font_loads == 1);
+    pdf_result_free(&info);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Font preservation test passed.\n");
+}
+
+// 测试用例：只有被改动的页面才重新生成内容流
+void test_pages_rewritten() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    for (int mode = 0; mode < 2; mode++) {
+        pdf_replace_options_t options;
+        pdf_replace_options_init(&options);
+        if (mode == 1) options.match_mode = PDF_MATCH_TEXT_PAGE;
+
+        pdf_result_t info;
+        size_t modified_size;
+        unsigned char* result = pdf_engine_replace_text(
+            engine, &options, input_data, input_size, "test", "sample", &modified_size, &info);
+        assert(result != NULL);
+
+        size_t hit_pages = 0;
+        for (int i = 0; i < info.page_count; i++) {
+            if (info.pages[i].hits > 0) hit_pages++;
+        }
+        assert(hit_pages > 0);
+        assert(hit_pages < (size_t)info.page_count);
+        assert(info.pages_rewritten == hit_pages);
+        pdf_result_free(&info);
+        free(result);
+    }
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Pages rewritten test passed.\n");
+}
+
+// 测试用例：增量保存的输出以原始字节开头，追加的修订可以被重新加载
+void test_incremental_save() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.save_mode = PDF_SAVE_INCREMENTAL;
+
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "test", "sample", &modified_size, NULL);
+    assert(result != NULL);
+    assert(modified_size > input_size);
+    assert(memcmp(result, input_data, input_size) == 0);
+
+    // 追加的修订生效：替换后的文本可以找到，原文本已不存在
+    size_t again_size;
+    unsigned char* again = pdf_engine_replace_text(
+        engine, NULL, result, modified_size, "sample", "sample", &again_size, NULL);
+    assert(again != NULL);
+    free(again);
+    again = pdf_engine_replace_text(
+        engine, NULL, result, modified_size, "test", "sample", &again_size, NULL);
+    assert(again == NULL);
+    assert(get_last_error() == PDF_ERROR_NO_TEXT_FOUND);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Incremental save test passed.\n");
+}
+
+// 测试用例：页面预筛选跳过没有目标文本的页面，命中数不变
+void test_page_prefilter() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replacement_t baseline = { "test", "sample", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &baseline, 1, &modified_size, NULL);
+    assert(result != NULL);
+    free(result);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.page_prefilter = 1;
+
+    pdf_result_t info;
+    pdf_replacement_t filtered = { "test", "sample", 0 };
+    result = pdf_engine_replace_batch(
+        engine, &options, input_data, input_size, &filtered, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(filtered.hits == baseline.hits);
+
+    size_t hit_pages = 0;
+    for (int i = 0; i < info.page_count; i++) {
+        if (info.pages[i].hits > 0) hit_pages++;
+    }
+    assert(info.pages_skipped > 0);
+    assert(info.pages_skipped + hit_pages <= (size_t)info.page_count);
+    pdf_result_free(&info);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Page prefilter test passed.\n");
+}
+
+// 测试用例：临时缓冲区的申请次数与文本对象数量无关
+void test_scratch_allocations() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // "e" 的命中远多于 "test"；暂存区逐页回退复用，申请次数只取决于最大的一页
+    const char* targets[] = { "test", "e" };
+    for (int mode = 0; mode < 2; mode++) {
+        for (int t = 0; t < 2; t++) {
+            pdf_replace_options_t options;
+            pdf_replace_options_init(&options);
+            if (mode == 1) options.match_mode = PDF_MATCH_TEXT_PAGE;
+
+            pdf_result_t info;
+            size_t modified_size;
+            unsigned char* result = pdf_engine_replace_text(
+                engine, &options, input_data, input_size, targets[t], "X", &modified_size, &info);
+            assert(result != NULL);
+            assert(info.scratch_allocations > 0);
+            assert(info.scratch_allocations <= 8);
+            assert(info.scratch_bytes > 0);
+            free(result);
+            pdf_result_free(&info);
+        }
+    }
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Scratch allocations test passed.\n");
+}
+
+// 测试用例：UTF-8 转 UTF-16 支持代理对，非法输入替换为 U+FFFD，SIMD 与标量实现结果一致
+void test_utf_transcoding() {
+    // 表情符号和扩展 B 区汉字需要代理对
+    const char* text = "a\xF0\x9F\x98\x80\xE6\xB7\xB1\xF0\xA0\x80\x80z";
+    unsigned short utf16[32];
+    size_t units = utf8_to_utf16(text, strlen(text), utf16);
+    const unsigned short expected[] = { 'a', 0xD83D, 0xDE00, 0x6DF1, 0xD840, 0xDC00, 'z' };
+    assert(units == sizeof(expected) / sizeof(expected[0]));
+    assert(memcmp(utf16, expected, sizeof(expected)) == 0);
+
+
+    // 过长编码、UTF-8 中的代理项和截断的序列
+    const char* invalid = "\xC0\xAF\xED\xA0\x80\xE6\xB7";
+    units = utf8_to_utf16(invalid, strlen(invalid), utf16);
+    for (size_t i = 0; i < units; i++) assert(utf16[i] == 0xFFFD);
+    assert(units == 6);
+
+    // 长文本覆盖向量路径：ASCII 片段与多字节字符交替
+    static const char* pieces[] = { "certificate ", "Gr\xC3\xB6\xC3\x9F" "e ", "\xE6\xB7\xB1 ", "\xF0\x9F\x98\x80", "x" };
+    size_t capacity = 8192, len = 0;
+    char* mixed = (char*)malloc(capacity);
+    assert(mixed != NULL);
+    for (int n = 0; len + 16 < capacity; n = (n * 7 + 3) % 5) {
+        size_t piece_len = strlen(pieces[n]);
+        memcpy(mixed + len, pieces[n], piece_len);
+        len += piece_len;
+    }
+    unsigned short* fast16 = (unsigned short*)malloc(len * sizeof(unsigned short));
+    unsigned short* slow16 = (unsigned short*)malloc(len * sizeof(unsigned short));
+    assert(fast16 && slow16);
+    units = utf8_to_utf16(mixed, len, fast16);
+    assert(units == utf8_to_utf16_scalar(mixed, len, slow16));
+    assert(memcmp(fast16, slow16, units * sizeof(unsigned short)) == 0);
+
+    free(mixed);
+    free(fast16);
+    free(slow16);
+    printf("UTF transcoding test passed.\n");
+}
+
+// 收集流式输出的回调状态
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    int calls;
+} stream_capture_t;
+
+static int capture_write(void* user_data, const void* data, size_t size) {
+    stream_capture_t* capture = (stream_capture_t*)user_data;
+    if (capture->size + size > capture->capacity) {
+        size_t capacity = (capture->size + size) * 2;
+        unsigned char* grown = (unsigned char*)realloc(capture->data, capacity);
+        if (!grown) return 0;
+        capture->data = grown;
+        capture->capacity = capacity;
+    }
+    memcpy(capture->data + capture->size, data, size);
+    capture->size += size;
+    capture->calls++;
+    return 1;
+}
+
+// 测试用例：流式输出到回调和文件描述符
+void test_streaming_output() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    size_t expected_size;
+    unsigned char* expected = pdf_engine_replace_text(
+        engine, NULL, input_data, input_size, "test", "sample", &expected_size, NULL);
+    assert(expected != NULL);
+    free(expected);
+
+    // 逐块写出
+    stream_capture_t unbatched = { NULL, 0, 0, 0 };
+    pdf_error_code_t code = pdf_engine_replace_text_to_callback(
+        engine, NULL, input_data, input_size, "test", "sample", capture_write, &unbatched, NULL);
+    assert(code == PDF_SUCCESS);
+    assert(unbatched.size == expected_size);
+    assert(memcmp(unbatched.data, "%PDF", 4) == 0);
+
+    // 合并小块后写出，回调次数应明显减少
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.write_batch_size = 65536;
+    stream_capture_t batched = { NULL, 0, 0, 0 };
+    code = pdf_engine_replace_text_to_callback(
+        engine, &options, input_data, input_size, "test", "sample", capture_write, &batched, NULL);
+    assert(code == PDF_SUCCESS);
+    assert(batched.size == expected_size);
+    assert(batched.calls < unbatched.calls);
+
+    // 未找到目标文本时不写出任何数据
+    stream_capture_t missing = { NULL, 0, 0, 0 };
+    code = pdf_engine_replace_text_to_callback(
+        engine, NULL, input_data, input_size, "nonexistent", "x", capture_write, &missing, NULL);
+    assert(code == PDF_ERROR_NO_TEXT_FOUND);
+    assert(missing.size == 0);
+
+    // 写入文件描述符
+    char path[] = "/tmp/pdf_handler_test_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    code = pdf_engine_replace_text_to_fd(
+        engine, &options, input_data, input_size, "test", "sample", fd, NULL);
+    assert(code == PDF_SUCCESS);
+    assert((size_t)lseek(fd, 0, SEEK_END) == expected_size);
+    close(fd);
+    unlink(path);
+
+    free(unbatched.data);
+    free(batched.data);
+    free(missing.data);
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Streaming output test passed.\n");
+}
+
+// 测试用例：分阶段耗时与计数
+void test_stage_stats() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    // 单线程时各阶段之和不超过总耗时
+    pdf_replacement_t replacements[] = { { "test", "sample", 0 } };
+    size_t modified_size;
+    pdf_result_t info;
+    unsigned char* modified = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, replacements, 1, &modified_size, &info);
+    assert(modified != NULL);
+    const pdf_stats_t* stats = &info.stats;
+    assert(stats->total_ms > 0 && stats->load_ms > 0 && stats->save_ms > 0);
+    double stages = stats->load_ms + stats->page_load_ms + stats->text_page_ms + stats->scan_ms +
+                    stats->apply_ms + stats->generate_ms + stats->save_ms;
+    assert(stages <= stats->total_ms + 0.001);
+    assert(stats->pages_loaded >= (size_t)info.page_count);
+    assert(stats->objects_scanned > 0);
+    assert(stats->hits == (size_t)replacements[0].hits);
+    assert(stats->bytes_in == input_size);
+    assert(stats->bytes_out == modified_size);
+    assert(stats->output_allocations >= 1 && stats->output_allocations < 64);
+    assert(stats->output_writes == 0);
+    free(modified);
+    pdf_result_free(&info);
+
+    // 流式输出记录写出次数，不分配输出缓冲区
+    stream_capture_t captured = { NULL, 0, 0, 0 };
+    pdf_error_code_t code = pdf_engine_replace_text_to_callback(
+        engine, NULL, input_data, input_size, "test", "sample", capture_write, &captured, &info);
+    assert(code == PDF_SUCCESS);
+    assert(info.stats.bytes_out == captured.size);
+    assert(info.stats.output_writes == (size_t)captured.calls);
+    assert(info.stats.output_allocations == 0);
+    free(captured.data);
+    pdf_result_free(&info);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Stage stats test passed.\n");
+}
+
+// 统计读取次数的内存读取器
+typedef struct {
+    const unsigned char* data;
+    size_t bytes_read;
+    int calls;
+} counting_reader_t;
+
+static int counting_read(void* user_data, size_t position, unsigned char* buffer, size_t size) {
+    counting_reader_t* reader = (counting_reader_t*)user_data;
+    memcpy(buffer, reader->data + position, size);
+    reader->bytes_read += size;
+    reader->calls++;
+    return 1;
+}
+
+// 测试用例：通过读取器按需加载文档
+void test_reader_input() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replacement_t in_memory = { "test", "sample", 0 };
+    size_t expected_size;
+    unsigned char* expected = pdf_engine_replace_batch(
+        engine, NULL, input_data, input_size, &in_memory, 1, &expected_size, NULL);
+    assert(expected != NULL);
+    free(expected);
+
+    // 回调读取器：分多次读取，结果与内存输入相同
+    counting_reader_t counting = { input_data, 0, 0 };
+    pdf_reader_t reader = { input_size, counting_read, &counting };
+    pdf_replacement_t from_callback = { "test", "sample", 0 };
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_batch_from_reader(
+        engine, NULL, &reader, &from_callback, 1, &modified_size, NULL);
+    assert(result != NULL);
+    assert(from_callback.hits == in_memory.hits);
+    assert(modified_size == expected_size);
+    assert(counting.calls > 1);
+    free(result);
+
+    // 文件描述符读取器，输出写入另一个文件描述符
+    int in_fd = open("tests/test.pdf", O_RDONLY);
+    assert(in_fd >= 0);
+    assert(pdf_reader_init_fd(&reader, in_fd) == PDF_SUCCESS);
+    assert(reader.size == input_size);
+
+    char path[] = "/tmp/pdf_handler_test_XXXXXX";
+    int out_fd = mkstemp(path);
+    assert(out_fd >= 0);
+    pdf_replacement_t from_fd = { "test", "sample", 0 };
+    pdf_error_code_t code = pdf_engine_replace_batch_from_reader_to_fd(
+        engine, NULL, &reader, &from_fd, 1, out_fd, NULL);
+    assert(code == PDF_SUCCESS);
+    assert(from_fd.hits == in_memory.hits);
+    assert((size_t)lseek(out_fd, 0, SEEK_END) == expected_size);
+    close(out_fd);
+    unlink(path);
+
+    // 未命中直通：输出是输入的副本
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.passthrough_on_miss = 1;
+    pdf_replacement_t missing = { "nonexistent", "x", 0 };
+    pdf_result_t info;
+    result = pdf_engine_replace_batch_from_reader(
+        engine, &options, &reader, &missing, 1, &modified_size, &info);
+    assert(result != NULL);
+    assert(info.passthrough == 1);
+    assert(modified_size == input_size);
+    assert(memcmp(result, input_data, input_size) == 0);
+    pdf_result_free(&info);
+    free(result);
+    close(in_fd);
+
+    // 无效的读取器
+    assert(pdf_engine_replace_batch_from_reader(
+        engine, NULL, NULL, &missing, 1, &modified_size, NULL) == NULL);
+    assert(get_last_error() == PDF_ERROR_INVALID_PARAMS);
+    assert(pdf_reader_init_fd(&reader, -1) == PDF_ERROR_INVALID_PARAMS);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Reader input test passed.\n");
+}
+
+// 测试用例：未命中直通模式返回原始输入而不是错误
+void test_passthrough_on_miss() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pdf_replace_options_t options;
+    pdf_replace_options_init(&options);
+    options.passthrough_on_miss = 1;
+
+    // 内存输出借用输入缓冲区
+    pdf_result_t info;
+    size_t modified_size = 0;
+    unsigned char* result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "nonexistent", "x", &modified_size, &info);
+    assert(result == input_data);
+    assert(modified_size == input_size);
+    assert(info.code == PDF_SUCCESS);
+    assert(info.passthrough == 1);
+    assert(info.pages_rewritten == 0);
+    assert(get_last_error() == PDF_SUCCESS);
+    pdf_result_free(&info);
+
+    // 流式输出原样写出输入
+    stream_capture_t captured;
+    memset(&captured, 0, sizeof(captured));
+    pdf_error_code_t code = pdf_engine_replace_text_to_callback(
+        engine, &options, input_data, input_size, "nonexistent", "x", capture_write, &captured, NULL);
+    assert(code == PDF_SUCCESS);
+    assert(captured.size == input_size);
+    assert(memcmp(captured.data, input_data, input_size) == 0);
+    free(captured.data);
+
+    // 有命中时照常替换
+    result = pdf_engine_replace_text(
+        engine, &options, input_data, input_size, "test", "sample", &modified_size, &info);
+    assert(result != NULL && result != input_data);
+    assert(info.passthrough == 0);
+    pdf_result_free(&info);
+    free(result);
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Passthrough on miss test passed.\n");
+}
+
+typedef struct {
+    pdf_engine_t* engine;
+    const unsigned char* data;
+    size_t size;
+    const char* target;
+    int succeeded;
+    pdf_error_code_t code;
+} concurrent_job_t;
+
+static void* run_concurrent_job(void* arg) {
+    concurrent_job_t* job = (concurrent_job_t*)arg;
+    pdf_result_t info;
+    size_t modified_size;
+    unsigned char* result = pdf_engine_replace_text(
+        job->engine, NULL, job->data, job->size, job->target, "sample", &modified_size, &info);
+    job->succeeded = result != NULL;
+    job->code = info.code;
+
+    // 线程局部的错误状态只反映本线程的调用
+    assert(get_last_error() == info.code);
+    free(result);
+    pdf_result_free(&info);
+    return NULL;
+}
+
+// 测试用例：多个线程同时在同一个引擎上替换
+void test_concurrent_replacements() {
+    size_t input_size;
+    unsigned char* input_data = read_file("tests/test.pdf", &input_size);
+    assert(input_data != NULL);
+
+    pdf_engine_t* engine = pdf_engine_create();
+    assert(engine != NULL);
+
+    pthread_t threads[CONCURRENT_THREADS];
+    concurrent_job_t jobs[CONCURRENT_THREADS];
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        jobs[i].engine = engine;
+        jobs[i].data = input_data;
+        jobs[i].size = input_size;
+        // 交替使用存在和不存在的目标文本，确保各线程的错误状态互不干扰
+        jobs[i].target = (i % 2 == 0) ? "test" : "nonexistent";
+        assert(pthread_create(&threads[i], NULL, run_concurrent_job, &jobs[i]) == 0);
+    }
+    for (int i = 0; i < CONCURRENT_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        if (i % 2 == 0) {
+            assert(jobs[i].succeeded && jobs[i].code == PDF_SUCCESS);
+        } else {
+            assert(!jobs[i].succeeded && jobs[i].code == PDF_ERROR_NO_TEXT_FOUND);
+        }
+    }
+
+    pdf_engine_destroy(engine);
+    free(input_data);
+    printf("Concurrent replacements test passed.\n");
+}
+
 int main() {
     test_simple_replacement();
     test_non_existent_text();
     test_longer_replacement();
     test_shorter_replacement();
+    test_engine_reuse();
+    test_result_diagnostics();
+    test_concurrent_replacements();
+    test_output_allocation();
+    test_streaming_output();
+    test_stage_stats();
+    test_batch_replacement();
+    test_adjacent_replacement();
+    test_text_page_search();
+    test_cross_object_replacement();
+    test_substring_replacement();
+    test_whole_object_removal();
+    test_search_only();
+    test_long_text_object();
+    test_many_first_units();
+    test_scratch_allocations();
+    test_font_cache();
+    test_font_preservation();
+    test_pages_rewritten();
+    test_incremental_save();
+    test_passthrough_on_miss();
+    test_page_prefilter();
+    test_reader_input();
+    test_utf_transcoding();
     printf("All tests passed!\n");
     return 0;
 }
@@ -1,9 +1,10 @@
 # WebAssembly 编译配置
 EMCC = emcc
 EMCFLAGS = -O2 \
+           -msimd128 \
            -s WASM=1 \
            -s EXPORTED_RUNTIME_METHODS='["ccall", "cwrap"]' \
-           -s EXPORTED_FUNCTIONS='["_replace_text_in_pdf_stream", "_get_last_error", "_malloc", "_free"]' \
+           -s EXPORTED_FUNCTIONS='["_replace_text_in_pdf_stream", "_get_last_error", "_pdf_engine_create", "_pdf_engine_destroy", "_pdf_engine_replace_text", "_pdf_engine_replace_batch", "_pdf_result_free", "_pdf_replace_options_init", "_pdf_engine_search", "_pdf_search_hits_free", "_malloc", "_free"]' \
            -s ALLOW_MEMORY_GROWTH=1 \
            -s USE_PTHREADS=0 \
            -s ASSERTIONS=1 \
@@ -14,7 +15,7 @@ EMCFLAGS = -O2 \
 WASM_DIR = wasm
 
 # 源文件
-WASM_SOURCES = src/pdf_handler.c
+WASM_SOURCES = src/pdf_handler.c src/utf_transcode.c
 
 # PDFium 静态库
 PDFIUM_LIB = lib/pdfium/lib/libpdfium.a